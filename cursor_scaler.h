@@ -0,0 +1,804 @@
+#ifndef CURSOR_SCALER_H_
+#define CURSOR_SCALER_H_
+
+#include "shake_common.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || \
+    defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+// GCC and Clang need per-function target attributes for SIMD intrinsics
+#if SIMD_X86 && defined(__GNUC__)
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_AVX2
+#endif
+
+// Cursor utilities class
+class CursorUtils {
+ public:
+  // Instruction set used by the resampling kernels
+  enum class SimdLevel { kScalar, kSse2, kAvx2 };
+
+  static SimdLevel DetectSimdLevel() {
+    static const SimdLevel level = [] {
+#if SIMD_X86
+#if defined(_MSC_VER)
+      int info[4];
+      __cpuid(info, 0);
+      const int max_leaf = info[0];
+      __cpuid(info, 1);
+      const bool sse2 = (info[3] & (1 << 26)) != 0;
+      // AVX state must also be enabled by the OS (OSXSAVE + XCR0)
+      const bool os_avx = (info[2] & (1 << 27)) != 0 &&
+                          (info[2] & (1 << 28)) != 0 &&
+                          (_xgetbv(0) & 0x6) == 0x6;
+      bool avx2 = false;
+      if (os_avx && max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+      }
+#else
+      __builtin_cpu_init();
+      const bool sse2 = __builtin_cpu_supports("sse2") != 0;
+      const bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+      if (avx2) return SimdLevel::kAvx2;
+      if (sse2) return SimdLevel::kSse2;
+#endif
+      return SimdLevel::kScalar;
+    }();
+    return level;
+  }
+
+  // Width of the cursor image in pixels; 0 on failure
+  static int GetCursorWidth(HCURSOR cursor) {
+    ICONINFO icon_info;
+    if (!GetIconInfo(cursor, &icon_info)) return 0;
+    BITMAP bm = {};
+    GetObject(icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask,
+              sizeof(bm), &bm);
+    if (icon_info.hbmColor) DeleteObject(icon_info.hbmColor);
+    if (icon_info.hbmMask) DeleteObject(icon_info.hbmMask);
+    return bm.bmWidth;
+  }
+
+  // FNV-1a hash of the hotspot and bitmap bits, which tells whether a
+  // shape really changed; 0 on failure
+  static uint64_t HashCursor(HCURSOR cursor) {
+    ICONINFO icon_info;
+    if (!GetIconInfo(cursor, &icon_info)) return 0;
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const void* data, size_t size) {
+      const auto* bytes = static_cast<const uint8_t*>(data);
+      for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+      }
+    };
+    mix(&icon_info.xHotspot, sizeof(icon_info.xHotspot));
+    mix(&icon_info.yHotspot, sizeof(icon_info.yHotspot));
+
+    bool hashed = true;
+    for (HBITMAP bitmap : {icon_info.hbmColor, icon_info.hbmMask}) {
+      if (!bitmap) continue;
+      BITMAP bm = {};
+      std::vector<uint32_t> pixels;
+      if (GetObject(bitmap, sizeof(bm), &bm)) {
+        pixels.resize(static_cast<size_t>(bm.bmWidth) * bm.bmHeight);
+        hashed = hashed &&
+                 ReadBitmapBits(bitmap, bm.bmWidth, bm.bmHeight, pixels.data());
+      } else {
+        hashed = false;
+      }
+      mix(&bm.bmWidth, sizeof(bm.bmWidth));
+      mix(&bm.bmHeight, sizeof(bm.bmHeight));
+      mix(pixels.data(), pixels.size() * sizeof(uint32_t));
+      DeleteObject(bitmap);
+    }
+    return hashed ? hash : 0;
+  }
+
+  static HCURSOR ScaleCursor(HCURSOR src_cursor, double scale_factor) {
+    HCURSOR new_cursor = ScaleCursorDib(src_cursor, scale_factor,
+                                        CursorConfig::kScaleFilter,
+                                        DetectSimdLevel());
+    // Monochrome cursors keep their XOR/invert pixels only through GDI
+    return new_cursor ? new_cursor : ScaleCursorGdi(src_cursor, scale_factor);
+  }
+
+  // Resamples the cursor bitmaps on the CPU in premultiplied alpha; returns
+  // nullptr for monochrome cursors
+  static HCURSOR ScaleCursorDib(HCURSOR src_cursor, double scale_factor,
+                                CursorConfig::ScaleFilter filter,
+                                SimdLevel simd_level) {
+    ScaledPixels scaled;
+    if (!ResampleCursor(src_cursor, scale_factor, filter, simd_level, false,
+                        scaled)) {
+      return nullptr;
+    }
+    return CreateCursorFromPremultiplied(scaled.pixels.data(), scaled.width,
+                                         scaled.height, scaled.x_hotspot,
+                                         scaled.y_hotspot);
+  }
+
+  // Scaled cursor in premultiplied 8-bit BGRA, as UpdateLayeredWindow
+  // expects it
+  struct CursorImage {
+    int width = 0;
+    int height = 0;
+    POINT hotspot = {0, 0};
+    std::vector<uint32_t> pixels;
+  };
+
+  // Scales any cursor into an image; monochrome cursors are included, with
+  // their inverted pixels drawn black
+  static bool ScaleCursorImage(HCURSOR src_cursor, double scale_factor,
+                               CursorImage& image) {
+    ScaledPixels scaled;
+    if (!ResampleCursor(src_cursor, scale_factor, CursorConfig::kScaleFilter,
+                        DetectSimdLevel(), true, scaled)) {
+      return false;
+    }
+
+    image.width = scaled.width;
+    image.height = scaled.height;
+    image.hotspot = {static_cast<LONG>(scaled.x_hotspot),
+                     static_cast<LONG>(scaled.y_hotspot)};
+    image.pixels.resize(static_cast<size_t>(scaled.width) * scaled.height);
+    for (size_t i = 0; i < image.pixels.size(); ++i) {
+      const float* pixel = &scaled.pixels[i * 4];
+      // Lanczos lobes can overshoot, so clamp to a valid premultiplied pixel
+      const float alpha = (std::min)((std::max)(pixel[3], 0.0f), 255.0f);
+      uint32_t value = static_cast<uint32_t>(alpha + 0.5f) << 24;
+      for (int c = 0; c < 3; ++c) {
+        float channel = (std::min)((std::max)(pixel[c], 0.0f), alpha);
+        value |= static_cast<uint32_t>(channel + 0.5f) << (c * 8);
+      }
+      image.pixels[i] = value;
+    }
+    return true;
+  }
+
+  static HCURSOR ScaleCursorGdi(HCURSOR src_cursor, double scale_factor) {
+    if (!src_cursor || scale_factor <= 0) {
+      return nullptr;
+    }
+
+    // Get cursor information
+    ICONINFO icon_info;
+    if (!GetIconInfo(src_cursor, &icon_info)) {
+      return nullptr;
+    }
+
+    // Use RAII to manage bitmap resources
+    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
+        color_bitmap(icon_info.hbmColor, DeleteObject);
+    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
+        mask_bitmap(icon_info.hbmMask, DeleteObject);
+
+    // Get bitmap information
+    BITMAP bm;
+    if (!GetObject(icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask,
+                   sizeof(BITMAP), &bm)) {
+      return nullptr;
+    }
+
+    // Calculate new dimensions
+    int new_width = static_cast<int>(bm.bmWidth * scale_factor);
+    int new_height = static_cast<int>(bm.bmHeight * scale_factor);
+
+    // Create compatible DC
+    HDC screen_dc = GetDC(nullptr);
+    if (!screen_dc) {
+      return nullptr;
+    }
+    HDC src_dc = CreateCompatibleDC(screen_dc);
+    HDC dst_dc = CreateCompatibleDC(screen_dc);
+    if (!src_dc || !dst_dc) {
+      if (src_dc) DeleteDC(src_dc);
+      if (dst_dc) DeleteDC(dst_dc);
+      ReleaseDC(nullptr, screen_dc);
+      return nullptr;
+    }
+
+    // Create new color bitmap and mask bitmap
+    HBITMAP new_color = nullptr;
+    HBITMAP new_mask = nullptr;
+    HCURSOR new_cursor = nullptr;
+
+    do {
+      // Create enlarged color bitmap
+      BITMAPINFO bmi = {0};
+      bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+      bmi.bmiHeader.biWidth = new_width;
+      bmi.bmiHeader.biHeight = new_height;
+      bmi.bmiHeader.biPlanes = 1;
+      bmi.bmiHeader.biBitCount = 32;
+      bmi.bmiHeader.biCompression = BI_RGB;
+
+      void* color_bits = nullptr;
+      new_color = CreateDIBSection(screen_dc, &bmi, DIB_RGB_COLORS, &color_bits,
+                                   nullptr, 0);
+      if (!new_color) break;
+
+      // Create mask bitmap
+      new_mask = CreateBitmap(new_width, new_height, 1, 1, nullptr);
+      if (!new_mask) break;
+
+      // Select source bitmap
+      HBITMAP old_src_color = (HBITMAP)SelectObject(
+          src_dc, icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask);
+      HBITMAP old_dst_color = (HBITMAP)SelectObject(dst_dc, new_color);
+
+      // Perform scaling
+      SetStretchBltMode(dst_dc, HALFTONE);
+      SetBrushOrgEx(dst_dc, 0, 0, nullptr);
+      StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0, bm.bmWidth,
+                 bm.bmHeight, SRCCOPY);
+
+      // If there is a color bitmap, also process the mask bitmap
+      if (icon_info.hbmColor) {
+        SelectObject(src_dc, icon_info.hbmMask);
+        SelectObject(dst_dc, new_mask);
+        StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0,
+                   bm.bmWidth, bm.bmHeight, SRCCOPY);
+      }
+
+      // Restore DC
+      SelectObject(src_dc, old_src_color);
+      SelectObject(dst_dc, old_dst_color);
+
+      // Create new cursor
+      ICONINFO new_icon_info = {0};
+      new_icon_info.fIcon =
+          FALSE;  // Specify creating a cursor instead of an icon
+      new_icon_info.xHotspot =
+          static_cast<DWORD>(icon_info.xHotspot * scale_factor);
+      new_icon_info.yHotspot =
+          static_cast<DWORD>(icon_info.yHotspot * scale_factor);
+      new_icon_info.hbmMask = new_mask;
+      new_icon_info.hbmColor = new_color;
+
+      new_cursor = CreateIconIndirect(&new_icon_info);
+
+    } while (false);
+
+    // Clean up resources
+    if (new_color) DeleteObject(new_color);
+    if (new_mask) DeleteObject(new_mask);
+    DeleteDC(src_dc);
+    DeleteDC(dst_dc);
+    ReleaseDC(nullptr, screen_dc);
+
+    return new_cursor;
+  }
+
+ private:
+  // Per output pixel source indices and normalized weights, padded to a fixed
+  // tap count so the kernels run without per-pixel branches
+  struct FilterWeights {
+    int taps = 0;
+    std::vector<int> indices;
+    std::vector<float> weights;
+  };
+
+  // Premultiplied BGRA floats in the 0..255 range
+  struct ScaledPixels {
+    int width = 0;
+    int height = 0;
+    DWORD x_hotspot = 0;
+    DWORD y_hotspot = 0;
+    std::vector<float> pixels;
+  };
+
+  // Monochrome cursors are only accepted with allow_monochrome; they have no
+  // premultiplied form for the XOR/invert pixels
+  static bool ResampleCursor(HCURSOR src_cursor, double scale_factor,
+                             CursorConfig::ScaleFilter filter,
+                             SimdLevel simd_level, bool allow_monochrome,
+                             ScaledPixels& scaled) {
+    if (!src_cursor || scale_factor <= 0) {
+      return false;
+    }
+
+    // Get cursor information
+    ICONINFO icon_info;
+    if (!GetIconInfo(src_cursor, &icon_info)) {
+      return false;
+    }
+
+    // Use RAII to manage bitmap resources
+    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
+        color_bitmap(icon_info.hbmColor, DeleteObject);
+    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
+        mask_bitmap(icon_info.hbmMask, DeleteObject);
+
+    const bool monochrome = !icon_info.hbmColor;
+    if (!icon_info.hbmMask || (monochrome && !allow_monochrome)) {
+      return false;
+    }
+
+    BITMAP bm;
+    if (!GetObject(monochrome ? icon_info.hbmMask : icon_info.hbmColor,
+                   sizeof(BITMAP), &bm)) {
+      return false;
+    }
+
+    // A monochrome mask stacks the AND mask on top of the XOR mask
+    const int src_width = bm.bmWidth;
+    const int src_height = monochrome ? bm.bmHeight / 2 : bm.bmHeight;
+    const int new_width = static_cast<int>(src_width * scale_factor);
+    const int new_height = static_cast<int>(src_height * scale_factor);
+    if (src_width <= 0 || src_height <= 0 || new_width <= 0 ||
+        new_height <= 0) {
+      return false;
+    }
+
+    const size_t src_pixels = static_cast<size_t>(src_width) * src_height;
+    std::vector<uint32_t> color_bits(src_pixels);
+    std::vector<uint32_t> mask_bits(src_pixels);
+    if (monochrome) {
+      std::vector<uint32_t> masks(src_pixels * 2);
+      if (!ReadBitmapBits(icon_info.hbmMask, src_width, src_height * 2,
+                          masks.data())) {
+        return false;
+      }
+      // AND 0 draws the XOR color; AND 1 with XOR 1 inverts the screen,
+      // which is approximated by black
+      for (size_t i = 0; i < src_pixels; ++i) {
+        const bool and_bit = (masks[i] & 0xFFFFFF) != 0;
+        const bool xor_bit = (masks[src_pixels + i] & 0xFFFFFF) != 0;
+        mask_bits[i] = (and_bit && !xor_bit) ? 0xFFFFFF : 0;
+        color_bits[i] = (!and_bit && xor_bit) ? 0xFFFFFF : 0;
+      }
+    } else if (!ReadBitmapBits(icon_info.hbmColor, src_width, src_height,
+                               color_bits.data()) ||
+               !ReadBitmapBits(icon_info.hbmMask, src_width, src_height,
+                               mask_bits.data())) {
+      return false;
+    }
+
+    // Cursors without an alpha channel take transparency from the AND mask
+    bool has_alpha = false;
+    for (uint32_t pixel : color_bits) {
+      if (pixel >> 24) {
+        has_alpha = true;
+        break;
+      }
+    }
+
+    // Convert to premultiplied BGRA floats in the 0..255 range
+    std::vector<float> src(src_pixels * 4);
+    for (size_t i = 0; i < src_pixels; ++i) {
+      const uint32_t pixel = color_bits[i];
+      float alpha = has_alpha ? static_cast<float>(pixel >> 24)
+                              : ((mask_bits[i] & 0xFFFFFF) ? 0.0f : 255.0f);
+      float factor = alpha / 255.0f;
+      src[i * 4 + 0] = static_cast<float>(pixel & 0xFF) * factor;
+      src[i * 4 + 1] = static_cast<float>((pixel >> 8) & 0xFF) * factor;
+      src[i * 4 + 2] = static_cast<float>((pixel >> 16) & 0xFF) * factor;
+      src[i * 4 + 3] = alpha;
+    }
+
+    // Separable resampling: rows first, then columns
+    const FilterWeights x_weights =
+        ComputeWeights(src_width, new_width, filter);
+    const FilterWeights y_weights =
+        ComputeWeights(src_height, new_height, filter);
+    std::vector<float> rows(static_cast<size_t>(new_width) * src_height * 4);
+    std::vector<float> dst(static_cast<size_t>(new_width) * new_height * 4);
+
+    switch (simd_level) {
+#if SIMD_X86
+      case SimdLevel::kAvx2:
+        ResampleRowsAvx2(src.data(), src_width, rows.data(), new_width,
+                         src_height, x_weights);
+        ResampleColumnsAvx2(rows.data(), new_width * 4, dst.data(),
+                            new_height, y_weights);
+        break;
+      case SimdLevel::kSse2:
+        ResampleRowsSse2(src.data(), src_width, rows.data(), new_width,
+                         src_height, x_weights);
+        ResampleColumnsSse2(rows.data(), new_width * 4, dst.data(),
+                            new_height, y_weights);
+        break;
+#endif
+      default:
+        ResampleRowsScalar(src.data(), src_width, rows.data(), new_width,
+                           src_height, x_weights);
+        ResampleColumnsScalar(rows.data(), new_width * 4, dst.data(),
+                              new_height, y_weights);
+        break;
+    }
+
+    scaled.width = new_width;
+    scaled.height = new_height;
+    scaled.x_hotspot = static_cast<DWORD>(icon_info.xHotspot * scale_factor);
+    scaled.y_hotspot = static_cast<DWORD>(icon_info.yHotspot * scale_factor);
+    scaled.pixels = std::move(dst);
+    return true;
+  }
+
+  static double FilterKernel(CursorConfig::ScaleFilter filter, double x) {
+    x = std::fabs(x);
+    if (filter == CursorConfig::ScaleFilter::kBilinear) {
+      return x < 1.0 ? 1.0 - x : 0.0;
+    }
+    // Lanczos with a = 3
+    if (x < 1e-8) return 1.0;
+    if (x >= 3.0) return 0.0;
+    const double pi_x = 3.14159265358979323846 * x;
+    return 3.0 * std::sin(pi_x) * std::sin(pi_x / 3.0) / (pi_x * pi_x);
+  }
+
+  static FilterWeights ComputeWeights(int src_size, int dst_size,
+                                      CursorConfig::ScaleFilter filter) {
+    const double scale = static_cast<double>(dst_size) / src_size;
+    const double radius =
+        (filter == CursorConfig::ScaleFilter::kLanczos3) ? 3.0 : 1.0;
+    // Widen the kernel when shrinking so every source pixel contributes
+    const double stretch = (scale < 1.0) ? 1.0 / scale : 1.0;
+    const double support = radius * stretch;
+
+    FilterWeights result;
+    result.taps = static_cast<int>(std::ceil(support * 2.0)) + 1;
+    result.indices.resize(static_cast<size_t>(dst_size) * result.taps);
+    result.weights.resize(static_cast<size_t>(dst_size) * result.taps);
+
+    for (int i = 0; i < dst_size; ++i) {
+      const double center = (i + 0.5) / scale - 0.5;
+      const int first = static_cast<int>(std::floor(center - support)) + 1;
+      int* indices = &result.indices[static_cast<size_t>(i) * result.taps];
+      float* weights = &result.weights[static_cast<size_t>(i) * result.taps];
+
+      double total = 0.0;
+      for (int k = 0; k < result.taps; ++k) {
+        const double weight =
+            FilterKernel(filter, (first + k - center) / stretch);
+        // Clamp to the edge pixel; padded taps simply weigh zero
+        indices[k] = (std::max)(0, (std::min)(first + k, src_size - 1));
+        weights[k] = static_cast<float>(weight);
+        total += weight;
+      }
+      if (total != 0.0) {
+        for (int k = 0; k < result.taps; ++k) {
+          weights[k] = static_cast<float>(weights[k] / total);
+        }
+      }
+    }
+    return result;
+  }
+
+  // Horizontal pass: src is rows x src_width pixels, dst rows x dst_width
+  static void ResampleRowsScalar(const float* src, int src_width, float* dst,
+                                 int dst_width, int rows,
+                                 const FilterWeights& fw) {
+    for (int y = 0; y < rows; ++y) {
+      const float* src_row = src + static_cast<size_t>(y) * src_width * 4;
+      float* dst_row = dst + static_cast<size_t>(y) * dst_width * 4;
+      for (int x = 0; x < dst_width; ++x) {
+        const int* indices = &fw.indices[static_cast<size_t>(x) * fw.taps];
+        const float* weights = &fw.weights[static_cast<size_t>(x) * fw.taps];
+        float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (int k = 0; k < fw.taps; ++k) {
+          const float* pixel = src_row + indices[k] * 4;
+          for (int c = 0; c < 4; ++c) acc[c] += weights[k] * pixel[c];
+        }
+        for (int c = 0; c < 4; ++c) dst_row[x * 4 + c] = acc[c];
+      }
+    }
+  }
+
+  // Vertical pass over rows of row_floats floats each
+  static void ResampleColumnsScalar(const float* src, int row_floats,
+                                    float* dst, int dst_rows,
+                                    const FilterWeights& fw) {
+    for (int y = 0; y < dst_rows; ++y) {
+      const int* indices = &fw.indices[static_cast<size_t>(y) * fw.taps];
+      const float* weights = &fw.weights[static_cast<size_t>(y) * fw.taps];
+      float* dst_row = dst + static_cast<size_t>(y) * row_floats;
+      std::fill(dst_row, dst_row + row_floats, 0.0f);
+      for (int k = 0; k < fw.taps; ++k) {
+        const float* src_row =
+            src + static_cast<size_t>(indices[k]) * row_floats;
+        const float weight = weights[k];
+        for (int i = 0; i < row_floats; ++i) dst_row[i] += weight * src_row[i];
+      }
+    }
+  }
+
+#if SIMD_X86
+  // One BGRA pixel per SSE register
+  TARGET_SSE2 static void ResampleRowsSse2(const float* src, int src_width,
+                                           float* dst, int dst_width,
+                                           int rows, const FilterWeights& fw) {
+    for (int y = 0; y < rows; ++y) {
+      const float* src_row = src + static_cast<size_t>(y) * src_width * 4;
+      float* dst_row = dst + static_cast<size_t>(y) * dst_width * 4;
+      for (int x = 0; x < dst_width; ++x) {
+        const int* indices = &fw.indices[static_cast<size_t>(x) * fw.taps];
+        const float* weights = &fw.weights[static_cast<size_t>(x) * fw.taps];
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          __m128 pixel = _mm_loadu_ps(src_row + indices[k] * 4);
+          acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), pixel));
+        }
+        _mm_storeu_ps(dst_row + x * 4, acc);
+      }
+    }
+  }
+
+  // row_floats is always a multiple of 4 (whole pixels)
+  TARGET_SSE2 static void ResampleColumnsSse2(const float* src, int row_floats,
+                                              float* dst, int dst_rows,
+                                              const FilterWeights& fw) {
+    for (int y = 0; y < dst_rows; ++y) {
+      const int* indices = &fw.indices[static_cast<size_t>(y) * fw.taps];
+      const float* weights = &fw.weights[static_cast<size_t>(y) * fw.taps];
+      float* dst_row = dst + static_cast<size_t>(y) * row_floats;
+      for (int i = 0; i < row_floats; i += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          const float* src_row =
+              src + static_cast<size_t>(indices[k]) * row_floats;
+          acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]),
+                                           _mm_loadu_ps(src_row + i)));
+        }
+        _mm_storeu_ps(dst_row + i, acc);
+      }
+    }
+  }
+
+  // Two output pixels per AVX register, each with its own taps
+  TARGET_AVX2 static void ResampleRowsAvx2(const float* src, int src_width,
+                                           float* dst, int dst_width,
+                                           int rows, const FilterWeights& fw) {
+    for (int y = 0; y < rows; ++y) {
+      const float* src_row = src + static_cast<size_t>(y) * src_width * 4;
+      float* dst_row = dst + static_cast<size_t>(y) * dst_width * 4;
+      int x = 0;
+      for (; x + 1 < dst_width; x += 2) {
+        const int* indices0 = &fw.indices[static_cast<size_t>(x) * fw.taps];
+        const int* indices1 = indices0 + fw.taps;
+        const float* weights0 =
+            &fw.weights[static_cast<size_t>(x) * fw.taps];
+        const float* weights1 = weights0 + fw.taps;
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          __m256 pixels = _mm256_insertf128_ps(
+              _mm256_castps128_ps256(_mm_loadu_ps(src_row + indices0[k] * 4)),
+              _mm_loadu_ps(src_row + indices1[k] * 4), 1);
+          __m256 weight = _mm256_insertf128_ps(
+              _mm256_castps128_ps256(_mm_set1_ps(weights0[k])),
+              _mm_set1_ps(weights1[k]), 1);
+          acc = _mm256_add_ps(acc, _mm256_mul_ps(weight, pixels));
+        }
+        _mm256_storeu_ps(dst_row + x * 4, acc);
+      }
+      for (; x < dst_width; ++x) {
+        const int* indices = &fw.indices[static_cast<size_t>(x) * fw.taps];
+        const float* weights = &fw.weights[static_cast<size_t>(x) * fw.taps];
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          __m128 pixel = _mm_loadu_ps(src_row + indices[k] * 4);
+          acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]), pixel));
+        }
+        _mm_storeu_ps(dst_row + x * 4, acc);
+      }
+    }
+    _mm256_zeroupper();
+  }
+
+  TARGET_AVX2 static void ResampleColumnsAvx2(const float* src, int row_floats,
+                                              float* dst, int dst_rows,
+                                              const FilterWeights& fw) {
+    for (int y = 0; y < dst_rows; ++y) {
+      const int* indices = &fw.indices[static_cast<size_t>(y) * fw.taps];
+      const float* weights = &fw.weights[static_cast<size_t>(y) * fw.taps];
+      float* dst_row = dst + static_cast<size_t>(y) * row_floats;
+      int i = 0;
+      for (; i + 8 <= row_floats; i += 8) {
+        __m256 acc = _mm256_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          const float* src_row =
+              src + static_cast<size_t>(indices[k]) * row_floats;
+          acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weights[k]),
+                                                 _mm256_loadu_ps(src_row + i)));
+        }
+        _mm256_storeu_ps(dst_row + i, acc);
+      }
+      for (; i < row_floats; i += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (int k = 0; k < fw.taps; ++k) {
+          const float* src_row =
+              src + static_cast<size_t>(indices[k]) * row_floats;
+          acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[k]),
+                                           _mm_loadu_ps(src_row + i)));
+        }
+        _mm_storeu_ps(dst_row + i, acc);
+      }
+    }
+    _mm256_zeroupper();
+  }
+#endif
+
+  // Reads a bitmap as top-down 32 bpp pixels; monochrome masks come back
+  // as black (0) and white (1) pixels
+  static bool ReadBitmapBits(HBITMAP bitmap, int width, int height,
+                             uint32_t* pixels) {
+    HDC screen_dc = GetDC(nullptr);
+    if (!screen_dc) {
+      return false;
+    }
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;  // Top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    int lines = GetDIBits(screen_dc, bitmap, 0, height, pixels, &bmi,
+                          DIB_RGB_COLORS);
+    ReleaseDC(nullptr, screen_dc);
+    return lines == height;
+  }
+
+  // Converts premultiplied BGRA floats back to a straight alpha cursor
+  static HCURSOR CreateCursorFromPremultiplied(const float* pixels, int width,
+                                               int height, DWORD x_hotspot,
+                                               DWORD y_hotspot) {
+    // Monochrome bitmap rows are WORD aligned
+    const int mask_stride = ((width + 15) / 16) * 2;
+    std::vector<BYTE> mask_bits(static_cast<size_t>(mask_stride) * height, 0);
+    std::vector<uint32_t> color_bits(static_cast<size_t>(width) * height);
+
+    for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+        const size_t index = static_cast<size_t>(y) * width + x;
+        const float* pixel = pixels + index * 4;
+        // Lanczos lobes can overshoot, so clamp before unpremultiplying
+        const float alpha = (std::min)((std::max)(pixel[3], 0.0f), 255.0f);
+        if (alpha < 0.5f) {
+          color_bits[index] = 0;
+          BYTE& bits = mask_bits[static_cast<size_t>(y) * mask_stride + x / 8];
+          bits = static_cast<BYTE>(bits | (0x80 >> (x % 8)));
+          continue;
+        }
+        uint32_t value = static_cast<uint32_t>(alpha + 0.5f) << 24;
+        for (int c = 0; c < 3; ++c) {
+          float channel = (std::min)((std::max)(pixel[c], 0.0f), alpha);
+          value |= static_cast<uint32_t>(channel * 255.0f / alpha + 0.5f)
+                   << (c * 8);
+        }
+        color_bits[index] = value;
+      }
+    }
+
+    HDC screen_dc = GetDC(nullptr);
+    if (!screen_dc) {
+      return nullptr;
+    }
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;  // Top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void* dib_bits = nullptr;
+    HBITMAP new_color = CreateDIBSection(screen_dc, &bmi, DIB_RGB_COLORS,
+                                         &dib_bits, nullptr, 0);
+    ReleaseDC(nullptr, screen_dc);
+    HBITMAP new_mask = CreateBitmap(width, height, 1, 1, mask_bits.data());
+
+    HCURSOR new_cursor = nullptr;
+    if (new_color && new_mask) {
+      memcpy(dib_bits, color_bits.data(), color_bits.size() * sizeof(uint32_t));
+
+      ICONINFO new_icon_info = {0};
+      new_icon_info.fIcon = FALSE;
+      new_icon_info.xHotspot = x_hotspot;
+      new_icon_info.yHotspot = y_hotspot;
+      new_icon_info.hbmMask = new_mask;
+      new_icon_info.hbmColor = new_color;
+      new_cursor = CreateIconIndirect(&new_icon_info);
+    }
+
+    if (new_color) DeleteObject(new_color);
+    if (new_mask) DeleteObject(new_mask);
+    return new_cursor;
+  }
+};
+
+// Micro-benchmark comparing the CPU resampling kernels with the GDI path
+class ScalerBenchmark {
+ public:
+  static std::wstring Run() {
+    HCURSOR src_cursor = LoadCursorW(nullptr, IDC_ARROW);
+    const CursorUtils::SimdLevel detected = CursorUtils::DetectSimdLevel();
+
+    std::wstringstream report;
+    report << L"Scaling IDC_ARROW by " << CursorConfig::kScaleFactor << L", "
+           << kIterations << L" iterations\n\n";
+    report << Measure(L"GDI StretchBlt", [&] {
+      return CursorUtils::ScaleCursorGdi(src_cursor,
+                                         CursorConfig::kScaleFactor);
+    });
+
+    const struct {
+      CursorConfig::ScaleFilter filter;
+      LPCWSTR name;
+    } filters[] = {{CursorConfig::ScaleFilter::kBilinear, L"Bilinear"},
+                   {CursorConfig::ScaleFilter::kLanczos3, L"Lanczos3"}};
+    const struct {
+      CursorUtils::SimdLevel level;
+      LPCWSTR name;
+    } levels[] = {{CursorUtils::SimdLevel::kScalar, L"scalar"},
+                  {CursorUtils::SimdLevel::kSse2, L"SSE2"},
+                  {CursorUtils::SimdLevel::kAvx2, L"AVX2"}};
+
+    for (const auto& filter : filters) {
+      for (const auto& level : levels) {
+        if (level.level > detected) continue;
+        std::wstring name = std::wstring(filter.name) + L" " + level.name;
+        report << Measure(name.c_str(), [&] {
+          return CursorUtils::ScaleCursorDib(src_cursor,
+                                             CursorConfig::kScaleFactor,
+                                             filter.filter, level.level);
+        });
+      }
+    }
+    return report.str();
+  }
+
+ private:
+  static constexpr int kIterations = 200;
+
+  template <typename ScaleFunc>
+  static std::wstring Measure(LPCWSTR name, ScaleFunc scale) {
+    long long start = HighResClock::NowMicroseconds();
+    int failures = 0;
+    for (int i = 0; i < kIterations; ++i) {
+      HCURSOR cursor = scale();
+      if (cursor) {
+        DestroyCursor(cursor);
+      } else {
+        failures++;
+      }
+    }
+    long long elapsed = HighResClock::NowMicroseconds() - start;
+
+    std::wstringstream line;
+    line << std::left << std::setw(20) << name << std::right << std::fixed
+         << std::setprecision(1) << std::setw(10)
+         << static_cast<double>(elapsed) / kIterations << L" us/cursor";
+    if (failures) {
+      line << L" (" << failures << L" failed)";
+    }
+    line << L"\n";
+    return line.str();
+  }
+};
+
+inline HCURSOR GetSystemArrowCursor() {
+  CURSORINFO ci = {sizeof(CURSORINFO)};
+  if (GetCursorInfo(&ci)) {
+    return CopyCursor(ci.hCursor);
+  }
+  return nullptr;
+}
+
+#endif  // CURSOR_SCALER_H_
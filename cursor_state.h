@@ -0,0 +1,1344 @@
+#ifndef CURSOR_STATE_H_
+#define CURSOR_STATE_H_
+
+// clang-format off
+#include "shake_common.h"
+#include "cursor_scaler.h"
+#include <dwmapi.h>
+#pragma comment(lib, "dwmapi.lib")
+// clang-format on
+
+// Windows 10 1803+; older SDKs do not define it
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+// Per-monitor DPI helpers. The APIs are resolved at run time because the
+// build targets Windows 7.
+class DpiUtils {
+ public:
+  static constexpr UINT kDefaultDpi = 96;
+
+  // Per-monitor v2 awareness needs Windows 10 1703; older systems get
+  // system DPI awareness as before
+  static void EnableDpiAwareness() {
+    using SetContextFunc = BOOL(WINAPI*)(HANDLE);
+    auto set_context = reinterpret_cast<SetContextFunc>(reinterpret_cast<void*>(
+        GetProcAddress(GetModuleHandleW(L"user32.dll"),
+                       "SetProcessDpiAwarenessContext")));
+    // DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2
+    if (set_context && set_context(reinterpret_cast<HANDLE>(-4))) return;
+    SetProcessDPIAware();
+  }
+
+  static UINT GetDpiForPoint(const POINT& pt) {
+    UINT dpi = GetDpiForMonitor(MonitorFromPoint(pt, MONITOR_DEFAULTTONEAREST));
+    return dpi ? dpi : GetSystemDpi();
+  }
+
+  // Distinct DPIs of the attached monitors, the one holding pt first
+  static std::vector<UINT> GetMonitorDpis(const POINT& pt) {
+    std::vector<UINT> dpis = {GetDpiForPoint(pt)};
+    EnumDisplayMonitors(nullptr, nullptr, AddMonitorDpi,
+                        reinterpret_cast<LPARAM>(&dpis));
+    return dpis;
+  }
+
+  // Size the system draws a cursor at for dpi
+  static int GetCursorSize(UINT dpi) {
+    using GetMetricsFunc = int(WINAPI*)(int, UINT);
+    static const auto get_metrics =
+        reinterpret_cast<GetMetricsFunc>(reinterpret_cast<void*>(
+            GetProcAddress(GetModuleHandleW(L"user32.dll"),
+                           "GetSystemMetricsForDpi")));
+    if (get_metrics) {
+      return get_metrics(SM_CXCURSOR, dpi);
+    }
+    return MulDiv(GetSystemMetrics(SM_CXCURSOR), static_cast<int>(dpi),
+                  static_cast<int>(GetSystemDpi()));
+  }
+
+ private:
+  static BOOL CALLBACK AddMonitorDpi(HMONITOR monitor, HDC, LPRECT,
+                                     LPARAM param) {
+    auto& dpis = *reinterpret_cast<std::vector<UINT>*>(param);
+    UINT dpi = GetDpiForMonitor(monitor);
+    if (dpi && std::find(dpis.begin(), dpis.end(), dpi) == dpis.end()) {
+      dpis.push_back(dpi);
+    }
+    return TRUE;
+  }
+
+  // Effective DPI from shcore (Windows 8.1); 0 if unavailable
+  static UINT GetDpiForMonitor(HMONITOR monitor) {
+    using GetDpiFunc = HRESULT(WINAPI*)(HMONITOR, int, UINT*, UINT*);
+    static const auto get_dpi =
+        reinterpret_cast<GetDpiFunc>(reinterpret_cast<void*>(GetProcAddress(
+            LoadLibraryW(L"shcore.dll"), "GetDpiForMonitor")));
+    UINT dpi_x = 0;
+    UINT dpi_y = 0;
+    // 0 is MDT_EFFECTIVE_DPI
+    if (!get_dpi || FAILED(get_dpi(monitor, 0, &dpi_x, &dpi_y))) return 0;
+    return dpi_x;
+  }
+
+  static UINT GetSystemDpi() {
+    HDC screen_dc = GetDC(nullptr);
+    int dpi = screen_dc ? GetDeviceCaps(screen_dc, LOGPIXELSX) : 0;
+    if (screen_dc) ReleaseDC(nullptr, screen_dc);
+    return dpi > 0 ? static_cast<UINT>(dpi) : kDefaultDpi;
+  }
+};
+
+// Persisted marker that is set while a run may replace system cursors, so
+// one that crashed, perhaps while enlarged, can be cleaned up by the next.
+// It is written at startup and clean exit only, keeping the registry off
+// the animation thread.
+class CursorRecovery {
+ public:
+  static void MarkDirty() { SetMarker(1); }
+
+  static void ClearDirty() { SetMarker(0); }
+
+  // Reloads the whole cursor scheme if a previous run did not exit cleanly;
+  // SPI_SETCURSORS is slow and broadcasts, so only do it then
+  static void RecoverIfDirty() {
+    DWORD value = 0;
+    DWORD size = sizeof(value);
+    if (RegGetValueW(HKEY_CURRENT_USER, kKeyPath, kValueName,
+                     RRF_RT_REG_DWORD, nullptr, &value,
+                     &size) != ERROR_SUCCESS ||
+        value == 0) {
+      return;
+    }
+    DEBUG_LOG("Restoring cursors left enlarged by a previous run");
+    SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE);
+    ClearDirty();
+  }
+
+ private:
+  static constexpr const wchar_t* kKeyPath = L"Software\\ShakeToFindCursor";
+  static constexpr const wchar_t* kValueName = L"CursorsReplaced";
+
+  static void SetMarker(DWORD value) {
+    HKEY key;
+    if (RegCreateKeyExW(HKEY_CURRENT_USER, kKeyPath, 0, nullptr, 0,
+                        KEY_SET_VALUE, nullptr, &key,
+                        nullptr) != ERROR_SUCCESS) {
+      return;
+    }
+    RegSetValueExW(key, kValueName, 0, REG_DWORD,
+                   reinterpret_cast<const BYTE*>(&value), sizeof(value));
+    RegCloseKey(key);
+  }
+};
+
+// Scaled cursors keyed by (cursor id, DPI, zoom level), bounded to
+// kCursorCacheCapacity entries by evicting the least recently used one.
+// Shared by the animation and background threads.
+class CursorCache {
+ public:
+  struct Key {
+    DWORD cursor_id;
+    UINT dpi;
+    int level;
+
+    bool operator==(const Key& other) const {
+      return cursor_id == other.cursor_id && dpi == other.dpi &&
+             level == other.level;
+    }
+  };
+
+  CursorCache() = default;
+  CursorCache(const CursorCache&) = delete;
+  CursorCache& operator=(const CursorCache&) = delete;
+
+  ~CursorCache() {
+    for (Entry& entry : entries_) {
+      DestroyEntry(entry);
+    }
+  }
+
+  bool Contains(const Key& key) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Find(key) != entries_.end();
+  }
+
+  // Returns a handle SetSystemCursor may take ownership of, or null on a
+  // miss. The pre-copied spare is handed out when there is one.
+  HCURSOR Acquire(const Key& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(key);
+    if (it == entries_.end()) return nullptr;
+    it->last_used = ++use_clock_;
+    HCURSOR cursor = it->spare;
+    it->spare = nullptr;
+    return cursor ? cursor : CopyCursor(it->cursor);
+  }
+
+  // Takes ownership of cursor
+  void Insert(const Key& key, HCURSOR cursor) {
+    HCURSOR spare = CopyCursor(cursor);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = Find(key);
+    if (it != entries_.end()) {
+      // Another thread filled it first
+      DestroyCursor(cursor);
+      if (spare) DestroyCursor(spare);
+      return;
+    }
+    if (entries_.size() >= CursorConfig::kCursorCacheCapacity) {
+      auto oldest = std::min_element(
+          entries_.begin(), entries_.end(),
+          [](const Entry& a, const Entry& b) {
+            return a.last_used < b.last_used;
+          });
+      DestroyEntry(*oldest);
+      *oldest = entries_.back();
+      entries_.pop_back();
+    }
+    entries_.push_back({key, cursor, spare, ++use_clock_});
+  }
+
+  // Drops every scaled version of cursor_id
+  void Evict(DWORD cursor_id) {
+    std::vector<Entry> evicted;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      auto kept = std::partition(
+          entries_.begin(), entries_.end(), [cursor_id](const Entry& entry) {
+            return entry.key.cursor_id != cursor_id;
+          });
+      evicted.assign(kept, entries_.end());
+      entries_.erase(kept, entries_.end());
+    }
+    // Destroyed outside the lock so that Acquire never waits on it
+    for (Entry& entry : evicted) {
+      DestroyEntry(entry);
+    }
+  }
+
+  // Replaces the spares consumed by Acquire. Must run on the thread that
+  // inserts and evicts, so the cursors it copies stay alive while the lock
+  // is released; Acquire never waits on the copies.
+  void RefillSpares() {
+    std::vector<Spare> spares;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const Entry& entry : entries_) {
+        if (!entry.spare) spares.push_back({entry.key, entry.cursor});
+      }
+    }
+    if (spares.empty()) return;
+    for (Spare& spare : spares) {
+      spare.cursor = CopyCursor(spare.cursor);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (Spare& spare : spares) {
+        auto it = Find(spare.key);
+        if (spare.cursor && it != entries_.end() && !it->spare) {
+          it->spare = spare.cursor;
+          spare.cursor = nullptr;
+        }
+      }
+    }
+    // The entry was dropped or refilled meanwhile
+    for (const Spare& spare : spares) {
+      if (spare.cursor) DestroyCursor(spare.cursor);
+    }
+  }
+
+ private:
+  struct Entry {
+    Key key;
+    HCURSOR cursor;
+    HCURSOR spare;
+    unsigned long long last_used;
+  };
+
+  struct Spare {
+    Key key;
+    HCURSOR cursor;
+  };
+
+  // The cache holds a few dozen entries, so a linear scan beats hashing
+  std::vector<Entry>::iterator Find(const Key& key) {
+    return std::find_if(
+        entries_.begin(), entries_.end(),
+        [&key](const Entry& entry) { return entry.key == key; });
+  }
+
+  std::vector<Entry>::const_iterator Find(const Key& key) const {
+    return std::find_if(
+        entries_.begin(), entries_.end(),
+        [&key](const Entry& entry) { return entry.key == key; });
+  }
+
+  static void DestroyEntry(Entry& entry) {
+    if (entry.spare) DestroyCursor(entry.spare);
+    if (entry.cursor) DestroyCursor(entry.cursor);
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<Entry> entries_;
+  unsigned long long use_clock_ = 0;
+};
+
+// Large cursor class
+class LargeCursor {
+ public:
+  // scheme_value names the entry under HKCU\Control Panel\Cursors that holds
+  // the file of this shape in the current cursor scheme
+  LargeCursor(LPCWSTR cursor_name, DWORD system_cursor_id,
+              LPCWSTR scheme_value)
+      : system_cursor_id_(system_cursor_id), scheme_value_(scheme_value) {
+    // Load the system cursor
+    shared_cursor_ = LoadCursorW(nullptr, cursor_name);
+    HCURSOR original = CopyCursor(shared_cursor_);
+    if (!original) {
+      throw std::runtime_error("Failed to load system cursor");
+    }
+    original_cursor_ = original;
+    content_hash_ = CursorUtils::HashCursor(original);
+    Refill(spare_original_, original);
+  }
+
+  DWORD Id() const { return system_cursor_id_; }
+
+  // Creates every zoom level missing from the cache for dpi, smallest
+  // first; safe to call from a background thread
+  bool Scale(UINT dpi, CursorCache& cache) const {
+    if (IsCached(dpi, cache)) return true;
+
+    const int native_size = DpiUtils::GetCursorSize(dpi);
+    HCURSOR native = LoadNativeCursor(native_size);
+    const HCURSOR source = native ? native : original_cursor_.load();
+    // The fallback is the 96 DPI image and needs the DPI factor on top
+    const double dpi_scale =
+        native ? 1.0
+               : static_cast<double>(native_size) /
+                     (std::max)(CursorUtils::GetCursorWidth(source), 1);
+
+    bool scaled = true;
+    for (int level = 1; level <= CursorConfig::kMaxZoomLevel; ++level) {
+      const CursorCache::Key key = {system_cursor_id_, dpi, level};
+      if (cache.Contains(key)) continue;
+
+      HCURSOR large_cursor = CursorUtils::ScaleCursor(
+          source, CursorConfig::ZoomLevelScale(level) * dpi_scale);
+      if (!large_cursor) {
+        scaled = false;
+        break;
+      }
+      cache.Insert(key, large_cursor);
+    }
+
+    if (native) DestroyCursor(native);
+    return scaled;
+  }
+
+  bool IsCached(UINT dpi, const CursorCache& cache) const {
+    for (int level = 1; level <= CursorConfig::kMaxZoomLevel; ++level) {
+      if (!cache.Contains({system_cursor_id_, dpi, level})) return false;
+    }
+    return true;
+  }
+
+  // True if handle is the shared system cursor this object replaces
+  bool Matches(HCURSOR handle) const { return handle == shared_cursor_; }
+
+  // SetSystemCursor takes ownership of the handle it is given, so both
+  // directions swap in a pre-copied handle and leave the copy for later.
+  // Returns false, leaving the cursor alone, if the level is not cached.
+  bool Enlarge(int level, UINT dpi, CursorCache& cache) {
+    HCURSOR cursor = cache.Acquire({system_cursor_id_, dpi, level});
+    if (!cursor) return false;
+    if (!SetSystemCursor(cursor, system_cursor_id_)) {
+      DestroyCursor(cursor);
+    }
+    return true;
+  }
+
+  void Restore() { SetFromPool(spare_original_, original_cursor_.load()); }
+
+  // Replaces the handle consumed by Restore; runs off the hot path
+  void RefillPool() { Refill(spare_original_, original_cursor_.load()); }
+
+  // Copy of what the system shows for this shape now, or null if it is
+  // the same as the original. Only meaningful while the shape is not
+  // replaced.
+  HCURSOR CaptureChanged(uint64_t* hash) const {
+    HCURSOR current = CopyCursor(shared_cursor_);
+    if (!current) return nullptr;
+    *hash = CursorUtils::HashCursor(current);
+    if (*hash && *hash == content_hash_) {
+      DestroyCursor(current);
+      return nullptr;
+    }
+    return current;
+  }
+
+  // Takes ownership of cursor as the new original and returns the old one,
+  // which Restore may be copying at this moment; runs on the background
+  // thread
+  HCURSOR ReplaceOriginal(HCURSOR cursor, uint64_t hash) {
+    content_hash_ = hash;
+    HCURSOR previous = original_cursor_.exchange(cursor);
+    if (HCURSOR spare = spare_original_.exchange(nullptr)) {
+      DestroyCursor(spare);
+    }
+    Refill(spare_original_, cursor);
+    return previous;
+  }
+
+  ~LargeCursor() {
+    if (HCURSOR spare = spare_original_.exchange(nullptr)) {
+      DestroyCursor(spare);
+    }
+    if (HCURSOR original = original_cursor_.load()) {
+      DestroyCursor(original);
+    }
+  }
+
+ private:
+  // Loads this shape from the cursor scheme file at its native size for
+  // the target DPI, so large sizes come from the artist's larger frames
+  // instead of an upscaled 32x32 image. Null if the scheme has no file.
+  HCURSOR LoadNativeCursor(int size) const {
+    wchar_t path[MAX_PATH];
+    DWORD path_size = sizeof(path);
+    // RegGetValue expands REG_EXPAND_SZ paths such as %SystemRoot%
+    if (RegGetValueW(HKEY_CURRENT_USER, L"Control Panel\\Cursors",
+                     scheme_value_, RRF_RT_REG_SZ | RRF_RT_REG_EXPAND_SZ,
+                     nullptr, path, &path_size) != ERROR_SUCCESS ||
+        path[0] == L'\0') {
+      return nullptr;
+    }
+    return static_cast<HCURSOR>(
+        LoadImageW(nullptr, path, IMAGE_CURSOR, size, size, LR_LOADFROMFILE));
+  }
+
+  void SetFromPool(std::atomic<HCURSOR>& spare, HCURSOR source) {
+    HCURSOR cursor = spare.exchange(nullptr);
+    if (!cursor) {
+      // The pool has not been refilled yet
+      cursor = CopyCursor(source);
+    }
+    if (cursor && !SetSystemCursor(cursor, system_cursor_id_)) {
+      DestroyCursor(cursor);
+    }
+  }
+
+  static void Refill(std::atomic<HCURSOR>& spare, HCURSOR source) {
+    if (spare.load() || !source) return;
+    HCURSOR cursor_copy = CopyCursor(source);
+    if (!cursor_copy) return;
+    HCURSOR expected = nullptr;
+    if (!spare.compare_exchange_strong(expected, cursor_copy)) {
+      DestroyCursor(cursor_copy);
+    }
+  }
+
+  DWORD system_cursor_id_;
+  LPCWSTR scheme_value_;
+  HCURSOR shared_cursor_ = nullptr;  // Shared handle, not owned
+  std::atomic<HCURSOR> original_cursor_{nullptr};
+  std::atomic<HCURSOR> spare_original_{nullptr};
+  uint64_t content_hash_ = 0;  // Of original_cursor_; background thread only
+};
+
+// Large cursor manager class
+class LargeCursorManager {
+ public:
+  LargeCursorManager() {
+    // Must run before the originals below are copied from the scheme
+    CursorRecovery::RecoverIfDirty();
+
+    // Create large cursor for each system cursor; CursorMask has room for 32
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_ARROW, OCR_NORMAL, L"Arrow"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_IBEAM, OCR_IBEAM, L"IBeam"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_WAIT, OCR_WAIT, L"Wait"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_CROSS, OCR_CROSS, L"Crosshair"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_UPARROW, OCR_UP, L"UpArrow"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_SIZENWSE, OCR_SIZENWSE, L"SizeNWSE"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_SIZENESW, OCR_SIZENESW, L"SizeNESW"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_SIZEWE, OCR_SIZEWE, L"SizeWE"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_SIZENS, OCR_SIZENS, L"SizeNS"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_SIZEALL, OCR_SIZEALL, L"SizeAll"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_NO, OCR_NO, L"No"));
+    large_cursors_.push_back(
+        std::make_unique<LargeCursor>(IDC_HAND, OCR_HAND, L"Hand"));
+    large_cursors_.push_back(std::make_unique<LargeCursor>(
+        IDC_APPSTARTING, OCR_APPSTARTING, L"AppStarting"));
+
+    CURSORINFO ci = {sizeof(CURSORINFO)};
+    if (!GetCursorInfo(&ci)) {
+      ci.ptScreenPos = {0, 0};
+    }
+    const UINT cursor_dpi = DpiUtils::GetDpiForPoint(ci.ptScreenPos);
+    if constexpr (CursorConfig::kLazyScaling) {
+      // Scale only the shape on screen now; the background thread does the
+      // rest so startup does not pay for 13 StretchBlt round trips
+      for (const auto& cursor : large_cursors_) {
+        if (cursor->Matches(ci.hCursor)) {
+          cursor->Scale(cursor_dpi, cache_);
+          break;
+        }
+      }
+    } else {
+      for (UINT dpi : PrefetchDpis(ci.ptScreenPos)) {
+        for (const auto& cursor : large_cursors_) {
+          if (!cursor->Scale(dpi, cache_)) {
+            throw std::runtime_error("Failed to create large cursor");
+          }
+        }
+      }
+      all_ready_ = true;
+    }
+    prefetch_point_ = ci.ptScreenPos;
+
+    // Background thread that finishes lazy scaling, fills the cache for
+    // DPIs that missed and replaces the handles consumed by each swap
+    background_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!background_event_) {
+      throw std::runtime_error("Failed to create background event");
+    }
+    background_running_ = true;
+    background_thread_ =
+        std::thread(&LargeCursorManager::BackgroundThreadProc, this);
+
+    // Stays set until the destructor has put everything back
+    CursorRecovery::MarkDirty();
+  }
+
+  ~LargeCursorManager() {
+    Restore(replaced_cursors_);
+    background_running_ = false;
+    SetEvent(background_event_);
+    if (background_thread_.joinable()) {
+      background_thread_.join();
+    }
+    CloseHandle(background_event_);
+    for (HCURSOR cursor : retired_originals_) {
+      DestroyCursor(cursor);
+    }
+    CursorRecovery::ClearDirty();
+  }
+
+  // One bit per shape, in the order the shapes are created
+  using CursorMask = uint32_t;
+
+  CursorMask AllCursors() const {
+    return (CursorMask{1} << large_cursors_.size()) - 1;
+  }
+
+  // Bit of the shape on screen; 0 if it is not one of the system shapes
+  CursorMask VisibleCursor() const {
+    CURSORINFO ci = {sizeof(CURSORINFO)};
+    if (!GetCursorInfo(&ci) || !(ci.flags & CURSOR_SHOWING)) return 0;
+    for (size_t i = 0; i < large_cursors_.size(); ++i) {
+      if (large_cursors_[i]->Matches(ci.hCursor)) {
+        return CursorMask{1} << i;
+      }
+    }
+    return 0;
+  }
+
+  // The cursor scheme or size changed: the originals that differ, and
+  // their scaled shapes, are rebuilt in the background
+  void OnSchemeChanged() {
+    originals_stale_.store(true);
+    scheme_changed_.store(true);
+    SetEvent(background_event_);
+  }
+
+  // Monitors or their DPIs changed: the new DPIs are scaled ahead of use
+  void OnDisplayChanged() {
+    displays_changed_.store(true, std::memory_order_relaxed);
+    SetEvent(background_event_);
+  }
+
+  // Shapes missing for this DPI are left as they are and scaled in the
+  // background for the next frame
+  void Enlarge(CursorMask mask, int level, UINT dpi) {
+    if (!replaced_cursors_) {
+      swap_generation_.fetch_add(1);
+    }
+    bool missed = false;
+    for (size_t i = 0; i < large_cursors_.size(); ++i) {
+      const CursorMask bit = CursorMask{1} << i;
+      if (!(mask & bit)) continue;
+      if (large_cursors_[i]->Enlarge(level, dpi, cache_)) {
+        replaced_cursors_ |= bit;
+      } else {
+        missed = true;
+      }
+    }
+    if (!replaced_cursors_) {
+      // Nothing was cached yet, so nothing is swapped out
+      swap_generation_.fetch_add(1);
+    }
+    if (missed) {
+      missed_dpi_.store(dpi, std::memory_order_relaxed);
+    }
+    SetEvent(background_event_);
+  }
+
+  // Puts back the cached originals of the replaced shapes in mask only
+  void Restore(CursorMask mask) {
+    mask &= replaced_cursors_;
+    if (!mask) return;
+    if (originals_stale_.load()) {
+      // The originals are from the previous scheme; have the system load
+      // the new one instead, without another change broadcast
+      SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, 0);
+      mask = replaced_cursors_;
+    } else {
+      for (size_t i = 0; i < large_cursors_.size(); ++i) {
+        if (mask & (CursorMask{1} << i)) {
+          large_cursors_[i]->Restore();
+        }
+      }
+    }
+    replaced_cursors_ &= ~mask;
+    if (!replaced_cursors_) {
+      swap_generation_.fetch_add(1);
+    }
+    SetEvent(background_event_);
+  }
+
+ private:
+  // DPIs worth scaling up front, limited to what the cache can hold
+  std::vector<UINT> PrefetchDpis(const POINT& pt) const {
+    const size_t entries_per_dpi =
+        large_cursors_.size() * CursorConfig::kMaxZoomLevel;
+    const size_t max_dpis = (std::max)(
+        CursorConfig::kCursorCacheCapacity / entries_per_dpi, size_t{1});
+    std::vector<UINT> dpis = DpiUtils::GetMonitorDpis(pt);
+    if (dpis.size() > max_dpis) {
+      dpis.resize(max_dpis);
+    }
+    return dpis;
+  }
+
+  void ScaleAll(UINT dpi) {
+    for (const auto& cursor : large_cursors_) {
+      if (!background_running_) return;
+      if (!cursor->Scale(dpi, cache_)) {
+        LOG_MESSAGE(LogLevel::kWarning, "Failed to create large cursor");
+      }
+    }
+  }
+
+  // Replaces the originals that no longer match the system's shapes and
+  // rescales those. Returns false if shapes were swapped out meanwhile, as
+  // the copies may then be enlarged ones; the next Restore wakes the
+  // thread to try again.
+  bool RebuildChangedCursors() {
+    const uint32_t generation = swap_generation_.load();
+    if (generation & 1) return false;
+
+    struct Change {
+      LargeCursor* cursor;
+      HCURSOR original;
+      uint64_t hash;
+    };
+    std::vector<Change> changes;
+    for (const auto& cursor : large_cursors_) {
+      uint64_t hash = 0;
+      if (HCURSOR original = cursor->CaptureChanged(&hash)) {
+        changes.push_back({cursor.get(), original, hash});
+      }
+    }
+    if (swap_generation_.load() != generation) {
+      for (const Change& change : changes) {
+        DestroyCursor(change.original);
+      }
+      return false;
+    }
+
+    DEBUG_LOG("Cursor scheme changed; rebuilding " +
+              std::to_string(changes.size()) + " shapes");
+    for (const Change& change : changes) {
+      retired_originals_.push_back(
+          change.cursor->ReplaceOriginal(change.original, change.hash));
+      cache_.Evict(change.cursor->Id());
+    }
+    retired_generation_ = swap_generation_.load();
+    POINT pt = {0, 0};
+    GetCursorPos(&pt);
+    for (UINT dpi : PrefetchDpis(pt)) {
+      for (const Change& change : changes) {
+        if (!background_running_) return true;
+        change.cursor->Scale(dpi, cache_);
+      }
+    }
+    return true;
+  }
+
+  // A Restore still copying a replaced original belongs to the swap that
+  // was running when it was replaced, so the originals go once that swap
+  // has ended, or at once if none was running
+  void ReleaseRetiredOriginals() {
+    if (retired_originals_.empty()) return;
+    if ((retired_generation_ & 1) &&
+        swap_generation_.load() == retired_generation_) {
+      return;
+    }
+    for (HCURSOR cursor : retired_originals_) {
+      DestroyCursor(cursor);
+    }
+    retired_originals_.clear();
+  }
+
+  void BackgroundThreadProc() {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+
+    if (!all_ready_) {
+      for (UINT dpi : PrefetchDpis(prefetch_point_)) {
+        ScaleAll(dpi);
+      }
+      all_ready_ = true;
+    }
+
+    while (WaitForSingleObject(background_event_, INFINITE) ==
+               WAIT_OBJECT_0 &&
+           background_running_) {
+      // Cleared first, so a change arriving during the rebuild runs another
+      if (scheme_changed_.exchange(false)) {
+        if (!RebuildChangedCursors()) {
+          scheme_changed_.store(true);
+        } else if (!scheme_changed_.load()) {
+          originals_stale_.store(false);
+          // A change may have landed between the two stores
+          if (scheme_changed_.load()) {
+            originals_stale_.store(true);
+          }
+        }
+      }
+      ReleaseRetiredOriginals();
+      if (displays_changed_.exchange(false, std::memory_order_relaxed)) {
+        POINT pt = {0, 0};
+        GetCursorPos(&pt);
+        for (UINT dpi : PrefetchDpis(pt)) {
+          ScaleAll(dpi);
+        }
+      }
+      if (UINT dpi = missed_dpi_.exchange(0, std::memory_order_relaxed)) {
+        ScaleAll(dpi);
+      }
+      cache_.RefillSpares();
+      for (const auto& cursor : large_cursors_) {
+        cursor->RefillPool();
+      }
+    }
+  }
+
+  std::vector<std::unique_ptr<LargeCursor>> large_cursors_;
+  CursorCache cache_;
+  POINT prefetch_point_ = {0, 0};
+  HANDLE background_event_ = nullptr;
+  std::thread background_thread_;
+  std::atomic<bool> background_running_{false};
+  std::atomic<bool> all_ready_{false};
+  std::atomic<UINT> missed_dpi_{0};  // DPI to scale for; 0 if none
+  std::atomic<bool> scheme_changed_{false};  // Rebuild pending
+  // Set from a change until a rebuild after it finished; Restore reloads
+  // the scheme meanwhile
+  std::atomic<bool> originals_stale_{false};
+  std::atomic<bool> displays_changed_{false};
+  // Odd while any shape is swapped out; bumped by the animation thread
+  std::atomic<uint32_t> swap_generation_{0};
+  // Originals replaced by a rebuild, and swap_generation_ when they were;
+  // used by the background thread only
+  std::vector<HCURSOR> retired_originals_;
+  uint32_t retired_generation_ = 0;
+  // Shapes currently swapped out; used by the animation thread only
+  CursorMask replaced_cursors_ = 0;
+};
+
+// Paces animation frames on display refresh boundaries. Sleeps on a
+// waitable timer rather than DwmFlush so a wait can be cut short.
+class FrameScheduler {
+ public:
+  FrameScheduler() {
+    // High resolution timers avoid the 15.6 ms scheduler tick
+    timer_ = CreateWaitableTimerExW(nullptr, nullptr,
+                                    CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                    TIMER_ALL_ACCESS);
+    if (!timer_) {
+      timer_ = CreateWaitableTimerW(nullptr, FALSE, nullptr);
+    }
+    if (!timer_) {
+      throw std::runtime_error("Failed to create frame timer");
+    }
+  }
+
+  ~FrameScheduler() { CloseHandle(timer_); }
+
+  FrameScheduler(const FrameScheduler&) = delete;
+  FrameScheduler& operator=(const FrameScheduler&) = delete;
+
+  // Time of the first vertical blank after now
+  long long NextFrameMicroseconds() const {
+    long long now = HighResClock::NowMicroseconds();
+    DWM_TIMING_INFO timing = {};
+    timing.cbSize = sizeof(timing);
+    if (FAILED(DwmGetCompositionTimingInfo(nullptr, &timing)) ||
+        timing.qpcRefreshPeriod == 0) {
+      return now + CursorConfig::kFallbackFramePeriodUs;
+    }
+    long long vblank = HighResClock::TicksToMicroseconds(
+        static_cast<long long>(timing.qpcVBlank));
+    long long period = HighResClock::TicksToMicroseconds(
+        static_cast<long long>(timing.qpcRefreshPeriod));
+    if (period <= 0) {
+      return now + CursorConfig::kFallbackFramePeriodUs;
+    }
+    long long frames = now >= vblank ? (now - vblank) / period + 1 : 0;
+    return vblank + frames * period;
+  }
+
+  // Sleeps until the deadline, until interrupt is signaled or until a
+  // message arrives; returns true if the deadline was reached
+  bool WaitUntil(long long deadline_us, HANDLE interrupt) const {
+    long long remaining = deadline_us - HighResClock::NowMicroseconds();
+    if (remaining <= 0) return true;
+
+    LARGE_INTEGER due_time;
+    due_time.QuadPart = -remaining * 10;  // Relative, in 100 ns units
+    if (!SetWaitableTimer(timer_, &due_time, 0, nullptr, nullptr, FALSE)) {
+      // Should not happen; fall back to a coarse sleep
+      DWORD result = MsgWaitForMultipleObjects(
+          1, &interrupt, FALSE, static_cast<DWORD>(remaining / 1000 + 1),
+          QS_ALLINPUT);
+      if (result == WAIT_OBJECT_0 + 1) {
+        PumpMessages();
+        return false;
+      }
+      return result == WAIT_TIMEOUT;
+    }
+    HANDLE handles[] = {timer_, interrupt};
+    DWORD result = MsgWaitForMultipleObjects(2, handles, FALSE, INFINITE,
+                                             QS_ALLINPUT);
+    if (result == WAIT_OBJECT_0 + 2) {
+      PumpMessages();
+      return false;
+    }
+    return result == WAIT_OBJECT_0;
+  }
+
+  // Sleeps until interrupt is signaled. The thread owns the overlay window,
+  // so it keeps pumping: broadcasts such as WM_SETTINGCHANGE wait for every
+  // top-level window.
+  static void WaitForInterrupt(HANDLE interrupt) {
+    while (MsgWaitForMultipleObjects(1, &interrupt, FALSE, INFINITE,
+                                     QS_ALLINPUT) == WAIT_OBJECT_0 + 1) {
+      PumpMessages();
+    }
+  }
+
+ private:
+  // Delivers WinEvent callbacks registered on this thread and messages for
+  // its windows
+  static void PumpMessages() {
+    MSG msg;
+    while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+      DispatchMessageW(&msg);
+    }
+  }
+
+  HANDLE timer_ = nullptr;
+};
+
+// Draws the enlarged cursor into a topmost, click-through layered window
+// that follows the pointer while the real cursor is hidden, so the cursor
+// scheme is never touched. Lives on the animation thread.
+class OverlayRenderer {
+ public:
+  OverlayRenderer() {
+    WNDCLASSEXW wc = {sizeof(WNDCLASSEXW)};
+    wc.lpfnWndProc = DefWindowProcW;
+    wc.hInstance = GetModuleHandle(nullptr);
+    wc.lpszClassName = kClassName;
+    RegisterClassExW(&wc);
+
+    hwnd_ = CreateWindowExW(WS_EX_LAYERED | WS_EX_TRANSPARENT |
+                                WS_EX_TOPMOST | WS_EX_TOOLWINDOW |
+                                WS_EX_NOACTIVATE,
+                            kClassName, L"", WS_POPUP, 0, 0, 0, 0, nullptr,
+                            nullptr, wc.hInstance, nullptr);
+    if (!hwnd_) {
+      throw std::runtime_error("Failed to create overlay window");
+    }
+    memory_dc_ = CreateCompatibleDC(nullptr);
+    if (!memory_dc_) {
+      DestroyWindow(hwnd_);
+      throw std::runtime_error("Failed to create overlay DC");
+    }
+
+    // The magnification API hides the real cursor without changing it;
+    // without it the normal cursor stays visible on top of the overlay
+    magnification_ = LoadLibraryW(L"magnification.dll");
+    if (magnification_) {
+      mag_initialize_ = GetFunction<MagBoolFunc>("MagInitialize");
+      mag_uninitialize_ = GetFunction<MagBoolFunc>("MagUninitialize");
+      mag_show_cursor_ = GetFunction<MagShowFunc>("MagShowSystemCursor");
+      if (!mag_initialize_ || !mag_uninitialize_ || !mag_initialize_()) {
+        mag_uninitialize_ = nullptr;
+        mag_show_cursor_ = nullptr;
+      }
+    }
+  }
+
+  ~OverlayRenderer() {
+    Hide();
+    if (bitmap_) {
+      SelectObject(memory_dc_, old_bitmap_);
+      DeleteObject(bitmap_);
+    }
+    DeleteDC(memory_dc_);
+    DestroyWindow(hwnd_);
+    if (mag_uninitialize_) mag_uninitialize_();
+    if (magnification_) FreeLibrary(magnification_);
+  }
+
+  OverlayRenderer(const OverlayRenderer&) = delete;
+  OverlayRenderer& operator=(const OverlayRenderer&) = delete;
+
+  // Draws the current cursor shape under the pointer at a zoom level of
+  // the size it has on a dpi monitor. A new shape or DPI renders every level
+  // into one DIB section; otherwise this only picks a level and moves the
+  // window.
+  void Show(int level, UINT dpi) {
+    CURSORINFO ci = {sizeof(CURSORINFO)};
+    if (!GetCursorInfo(&ci) || !ci.hCursor) return;
+    // Applications that hide the cursor get no overlay either
+    if (!visible_ && !(ci.flags & CURSOR_SHOWING)) return;
+
+    if (ci.hCursor != source_ || dpi != dpi_) {
+      if (!RenderPyramid(ci.hCursor, dpi)) return;
+      source_ = ci.hCursor;
+      dpi_ = dpi;
+    }
+
+    const PyramidLevel& entry = pyramid_[(std::clamp)(
+        level, 1, CursorConfig::kMaxZoomLevel) - 1];
+    POINT position = {ci.ptScreenPos.x - entry.hotspot.x,
+                      ci.ptScreenPos.y - entry.hotspot.y};
+    POINT origin = {0, entry.top};
+    SIZE size = entry.size;
+    BLENDFUNCTION blend = {AC_SRC_OVER, 0, 255, AC_SRC_ALPHA};
+    UpdateLayeredWindow(hwnd_, nullptr, &position, &size, memory_dc_, &origin,
+                        0, &blend, ULW_ALPHA);
+
+    if (!visible_) {
+      SetWindowPos(hwnd_, HWND_TOPMOST, 0, 0, 0, 0,
+                   SWP_NOMOVE | SWP_NOSIZE | SWP_NOACTIVATE | SWP_SHOWWINDOW);
+      if (mag_show_cursor_) mag_show_cursor_(FALSE);
+      visible_ = true;
+    }
+  }
+
+  // Renders the pyramid again on the next Show, for a changed scheme that
+  // kept the same cursor handles
+  void Invalidate() { source_ = nullptr; }
+
+  void Hide() {
+    if (!visible_) return;
+    ShowWindow(hwnd_, SW_HIDE);
+    if (mag_show_cursor_) mag_show_cursor_(TRUE);
+    visible_ = false;
+    // The pyramid is kept, so the next shake of the same shape renders
+    // nothing
+  }
+
+ private:
+  using MagBoolFunc = BOOL(WINAPI*)();
+  using MagShowFunc = BOOL(WINAPI*)(BOOL);
+
+  static constexpr const wchar_t* kClassName = L"ShakeToFindCursorOverlay";
+
+  template <typename Func>
+  Func GetFunction(const char* name) const {
+    return reinterpret_cast<Func>(
+        reinterpret_cast<void*>(GetProcAddress(magnification_, name)));
+  }
+
+  // Where one zoom level sits in the pyramid bitmap
+  struct PyramidLevel {
+    int top;
+    SIZE size;
+    POINT hotspot;
+  };
+
+  // Scales the cursor to every zoom level and stacks the images in one
+  // top-down DIB section selected into memory_dc_
+  bool RenderPyramid(HCURSOR cursor, UINT dpi) {
+    const int width = CursorUtils::GetCursorWidth(cursor);
+    const double dpi_scale =
+        width > 0 ? static_cast<double>(DpiUtils::GetCursorSize(dpi)) / width
+                  : 1.0;
+    std::array<CursorUtils::CursorImage, CursorConfig::kMaxZoomLevel> images;
+    std::array<PyramidLevel, CursorConfig::kMaxZoomLevel> pyramid;
+    int pyramid_width = 0;
+    int pyramid_height = 0;
+    for (size_t i = 0; i < images.size(); ++i) {
+      const double scale =
+          CursorConfig::ZoomLevelScale(static_cast<int>(i) + 1) * dpi_scale;
+      if (!CursorUtils::ScaleCursorImage(cursor, scale, images[i])) {
+        return false;
+      }
+      pyramid[i] = {pyramid_height,
+                    {images[i].width, images[i].height},
+                    images[i].hotspot};
+      pyramid_width = (std::max)(pyramid_width, images[i].width);
+      pyramid_height += images[i].height;
+    }
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = pyramid_width;
+    bmi.bmiHeader.biHeight = -pyramid_height;  // Top-down
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void* bits = nullptr;
+    HBITMAP bitmap = CreateDIBSection(memory_dc_, &bmi, DIB_RGB_COLORS, &bits,
+                                      nullptr, 0);
+    if (!bitmap) return false;
+    // Narrower levels leave the rest of their rows transparent, as DIB
+    // section memory starts out zeroed
+    uint32_t* pixels = static_cast<uint32_t*>(bits);
+    for (size_t i = 0; i < images.size(); ++i) {
+      const CursorUtils::CursorImage& image = images[i];
+      for (int y = 0; y < image.height; ++y) {
+        memcpy(pixels + static_cast<size_t>(pyramid[i].top + y) * pyramid_width,
+               image.pixels.data() + static_cast<size_t>(y) * image.width,
+               image.width * sizeof(uint32_t));
+      }
+    }
+
+    HGDIOBJ previous = SelectObject(memory_dc_, bitmap);
+    if (bitmap_) {
+      DeleteObject(bitmap_);
+    } else {
+      old_bitmap_ = previous;
+    }
+    bitmap_ = bitmap;
+    pyramid_ = pyramid;
+    return true;
+  }
+
+  HWND hwnd_ = nullptr;
+  HDC memory_dc_ = nullptr;
+  HBITMAP bitmap_ = nullptr;
+  HGDIOBJ old_bitmap_ = nullptr;
+  std::array<PyramidLevel, CursorConfig::kMaxZoomLevel> pyramid_ = {};
+  HCURSOR source_ = nullptr;  // Shape and DPI the pyramid was rendered for
+  UINT dpi_ = 0;
+  bool visible_ = false;
+  HMODULE magnification_ = nullptr;
+  MagBoolFunc mag_initialize_ = nullptr;
+  MagBoolFunc mag_uninitialize_ = nullptr;
+  MagShowFunc mag_show_cursor_ = nullptr;
+};
+
+// Cursor state management class. A dedicated thread steps the cursors
+// through the zoom levels, one per display frame, holds the full size for
+// kEnlargeDurationMs and then shrinks them back the same way. A shake that
+// goes on keeps the cursor enlarged and grows it further, up to
+// kMaxZoomLevel.
+class CursorState {
+ public:
+  CursorState() {
+    animation_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!animation_event_) {
+      throw std::runtime_error("Failed to create animation event");
+    }
+    animation_running_ = true;
+    animation_thread_ = std::thread(&CursorState::AnimationThreadProc, this);
+  }
+
+  ~CursorState() {
+    DEBUG_LOG("CursorState destroyed");
+    animation_running_ = false;
+    SetEvent(animation_event_);
+    if (animation_thread_.joinable()) {
+      animation_thread_.join();
+    }
+    CloseHandle(animation_event_);
+    // large_cursor_manager_ restores whatever is still replaced
+  }
+
+  // Takes effect from the next animation on
+  void SetRenderMode(CursorConfig::RenderMode mode) {
+    render_mode_.store(mode, std::memory_order_relaxed);
+  }
+
+  // For WM_SETTINGCHANGE with SPI_SETCURSORS; returns at once
+  void OnCursorSchemeChanged() {
+    large_cursor_manager_.OnSchemeChanged();
+    overlay_stale_.store(true, std::memory_order_relaxed);
+  }
+
+  // For WM_DISPLAYCHANGE and DPI changes; returns at once
+  void OnDisplayChanged() { large_cursor_manager_.OnDisplayChanged(); }
+
+  // Starts the zoom animation towards level, or extends and grows the
+  // running one. The triggering sample's time measures the input-to-enlarge
+  // latency.
+  void Enlarge(long long trigger_time_us, int level) {
+    trigger_time_us_.store(trigger_time_us, std::memory_order_relaxed);
+    requested_level_.store(level, std::memory_order_relaxed);
+    enlarge_requested_.store(true, std::memory_order_release);
+    SetEvent(animation_event_);
+  }
+
+ private:
+  enum class Phase { kIdle, kGrowing, kHolding, kShrinking };
+
+  void AnimationThreadProc() {
+    // Frames are short and deadline driven
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_ABOVE_NORMAL);
+
+    animation_owner_ = this;
+    Phase phase = Phase::kIdle;
+    long long hold_deadline_us = 0;
+    long long next_grow_us = 0;  // When a continued shake may add a level
+    int target_level = 0;
+    long long trigger_time_us = 0;  // Set until the first enlarged frame
+    while (animation_running_) {
+      if (enlarge_requested_.exchange(false, std::memory_order_acquire)) {
+        const long long now_us = HighResClock::NowMicroseconds();
+        const int requested_level =
+            requested_level_.load(std::memory_order_relaxed);
+        hold_deadline_us = now_us + CursorConfig::kEnlargeDurationMs * 1000LL;
+        if (phase == Phase::kGrowing || phase == Phase::kHolding) {
+          // The shake goes on: keep the cursor up and grow it one level per
+          // kGrowIntervalMs, or straight to a faster shake's level
+          if (now_us >= next_grow_us) {
+            target_level =
+                (std::min)(target_level + 1, CursorConfig::kMaxZoomLevel);
+            next_grow_us = now_us + CursorConfig::kGrowIntervalMs * 1000LL;
+          }
+          target_level = (std::max)(target_level, requested_level);
+          if (level_ < target_level) phase = Phase::kGrowing;
+          continue;
+        }
+
+        phase = Phase::kGrowing;
+        target_level = requested_level;
+        next_grow_us = now_us + CursorConfig::kGrowIntervalMs * 1000LL;
+        // The whole animation uses the DPI of the monitor it started on
+        POINT pt = {0, 0};
+        GetCursorPos(&pt);
+        dpi_ = DpiUtils::GetDpiForPoint(pt);
+        if (level_ == 0) {
+          use_overlay_ = ShouldUseOverlay();
+          if (overlay_ && overlay_stale_.exchange(false)) {
+            overlay_->Invalidate();
+          }
+          trigger_time_us = trigger_time_us_.load(std::memory_order_relaxed);
+        }
+        if (!use_overlay_) {
+          SelectCursors();
+        }
+      }
+
+      switch (phase) {
+        case Phase::kIdle:
+          FrameScheduler::WaitForInterrupt(animation_event_);
+          break;
+
+        case Phase::kGrowing:
+          // A shake restarting a shrinking cursor may already be above the
+          // level it asked for
+          if (level_ < target_level) {
+            SetLevel(level_ + 1);
+          }
+          if (trigger_time_us) {
+            LatencyStats::GetInstance().RecordEnlarge(trigger_time_us, dpi_,
+                                                      use_overlay_);
+            trigger_time_us = 0;
+          }
+          if (level_ >= target_level) {
+            phase = Phase::kHolding;
+          } else {
+            // Further requests only raise the target, which the next frame
+            // picks up, so only a shutdown may cut the frame short
+            long long next_frame = frame_scheduler_.NextFrameMicroseconds();
+            while (!frame_scheduler_.WaitUntil(next_frame, animation_event_) &&
+                   animation_running_) {
+            }
+          }
+          break;
+
+        case Phase::kHolding:
+          if (use_overlay_) {
+            // The overlay follows the pointer on every frame of the hold
+            long long next_frame = (std::min)(
+                frame_scheduler_.NextFrameMicroseconds(), hold_deadline_us);
+            if (frame_scheduler_.WaitUntil(next_frame, animation_event_)) {
+              if (next_frame >= hold_deadline_us) {
+                RecordHoldOvershoot(hold_deadline_us);
+                phase = Phase::kShrinking;
+              } else {
+                SetLevel(level_);
+              }
+            }
+          } else if (frame_scheduler_.WaitUntil(hold_deadline_us,
+                                                animation_event_)) {
+            // An early wake-up re-enters the wait, with a later deadline if
+            // the shake went on
+            RecordHoldOvershoot(hold_deadline_us);
+            phase = Phase::kShrinking;
+          }
+          break;
+
+        case Phase::kShrinking:
+          // Shrinking starts on the next frame after the hold
+          if (frame_scheduler_.WaitUntil(
+                  frame_scheduler_.NextFrameMicroseconds(), animation_event_)) {
+            SetLevel(level_ - 1);
+            if (level_ == 0) {
+              phase = Phase::kIdle;
+            }
+          }
+          break;
+      }
+    }
+
+    if (shape_hook_) {
+      UnhookWinEvent(shape_hook_);
+    }
+    // The window belongs to this thread
+    overlay_.reset();
+  }
+
+  static void RecordHoldOvershoot(long long hold_deadline_us) {
+    LatencyStats::GetInstance().Record(
+        LatencyStats::Histogram::kHoldOvershoot,
+        (HighResClock::NowMicroseconds() - hold_deadline_us) * 1000);
+  }
+
+  // Creates the overlay on first use; falls back to swapping system
+  // cursors if it cannot be created
+  bool ShouldUseOverlay() {
+    if (render_mode_.load(std::memory_order_relaxed) !=
+            CursorConfig::RenderMode::kOverlay ||
+        overlay_failed_) {
+      return false;
+    }
+    if (!overlay_) {
+      try {
+        overlay_ = std::make_unique<OverlayRenderer>();
+      } catch (const std::exception& e) {
+        LOG_MESSAGE(LogLevel::kWarning,
+                    "Overlay unavailable: " + std::string(e.what()));
+        overlay_failed_ = true;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Picks the shapes to animate. Selective mode starts with the one on
+  // screen and watches for shape changes to add the others as they appear.
+  void SelectCursors() {
+    if constexpr (!CursorConfig::kSelectiveEnlarge) {
+      active_cursors_ = large_cursor_manager_.AllCursors();
+      return;
+    }
+    LargeCursorManager::CursorMask visible =
+        large_cursor_manager_.VisibleCursor();
+    if (!visible) {
+      // An application cursor is showing; the shape it switches to is
+      // unknown, so fall back to all of them
+      visible = large_cursor_manager_.AllCursors();
+    }
+    active_cursors_ |= visible;
+    if (!shape_hook_) {
+      // Out-of-context events arrive through the message pump in
+      // FrameScheduler::WaitUntil on this thread
+      shape_hook_ = SetWinEventHook(
+          EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, nullptr,
+          ShapeChangeProc, 0, 0, WINEVENT_OUTOFCONTEXT);
+    }
+  }
+
+  static void CALLBACK ShapeChangeProc(HWINEVENTHOOK, DWORD, HWND,
+                                       LONG id_object, LONG, DWORD, DWORD) {
+    if (id_object == OBJID_CURSOR && animation_owner_) {
+      animation_owner_->PromoteVisibleCursor();
+    }
+  }
+
+  // Brings a shape that appeared mid-animation up to the current level
+  void PromoteVisibleCursor() {
+    LargeCursorManager::CursorMask visible =
+        large_cursor_manager_.VisibleCursor();
+    if (!visible || (active_cursors_ & visible) || level_ == 0) return;
+    active_cursors_ |= visible;
+    large_cursor_manager_.Enlarge(visible, level_, dpi_);
+  }
+
+  void SetLevel(int level) {
+    ScopedLatency frame(LatencyStats::Histogram::kFrame);
+    level_ = level;
+    if (use_overlay_) {
+      if (level > 0) {
+        overlay_->Show(level, dpi_);
+      } else {
+        overlay_->Hide();
+      }
+      return;
+    }
+    if (level > 0) {
+      large_cursor_manager_.Enlarge(active_cursors_, level, dpi_);
+      return;
+    }
+    large_cursor_manager_.Restore(active_cursors_);
+    active_cursors_ = 0;
+    if (shape_hook_) {
+      UnhookWinEvent(shape_hook_);
+      shape_hook_ = nullptr;
+    }
+  }
+
+  LargeCursorManager large_cursor_manager_;
+  FrameScheduler frame_scheduler_;
+  // Used by the animation thread only
+  static inline thread_local CursorState* animation_owner_ = nullptr;
+  UINT dpi_ = DpiUtils::kDefaultDpi;
+  int level_ = 0;  // 0 is the original size
+  LargeCursorManager::CursorMask active_cursors_ = 0;
+  HWINEVENTHOOK shape_hook_ = nullptr;
+  std::unique_ptr<OverlayRenderer> overlay_;
+  bool use_overlay_ = false;  // Backend of the running animation
+  bool overlay_failed_ = false;
+  std::atomic<CursorConfig::RenderMode> render_mode_{
+      CursorConfig::RenderMode::kSystemCursor};
+  HANDLE animation_event_ = nullptr;
+  std::thread animation_thread_;
+  std::atomic<bool> animation_running_{false};
+  std::atomic<bool> enlarge_requested_{false};
+  std::atomic<bool> overlay_stale_{false};  // Scheme changed since rendered
+  std::atomic<long long> trigger_time_us_{0};
+  std::atomic<int> requested_level_{CursorConfig::kZoomLevels};
+};
+
+#endif  // CURSOR_STATE_H_
@@ -1,89 +1,22 @@
-#define _WIN32_WINNT 0x0601
-#define WIN32_LEAN_AND_MEAN
-#define OEMRESOURCE
-
 // clang-format off
+#include "shake_common.h"
 #include <atlbase.h>
 #include <shellapi.h>
-#include <chrono>
-#include <cmath>
-#include <fstream>
-#include <iomanip>
-#include <iostream>
-#include <memory>
-#include <sstream>
-#include <deque>
-#include <vector>
-#include <stdexcept>
-#include "resource.h"
 #include <taskschd.h>
 #include <comdef.h>
+#include <wtsapi32.h>
+#include <future>
+#include "cursor_scaler.h"
+#include "cursor_state.h"
+#include "mouse_detector.h"
+#include "mouse_trace.h"
+#include "shared_stats.h"
+#include "resource.h"
 #pragma comment(lib, "taskschd.lib")
 #pragma comment(lib, "comsupp.lib")
-
-
-
-// Configuration class to manage all configurable parameters
-class CursorConfig {
- public:
-  static constexpr double kScaleFactor = 3.0;           // Cursor enlargement factor
-  static constexpr size_t kHistorySize = 10;            // Keep last 10 movements
-  static constexpr int kMinDirectionChanges = 5;        // Minimum direction changes required
-  static constexpr double kMinMovementSpeed = 800.0;    // Minimum speed in pixels/second
-  static constexpr int kMaxTimeWindow = 500;            // Time window in milliseconds
-  static constexpr int kEnlargeDurationMs = 500;        // Cursor enlargement duration (milliseconds)
-  static constexpr UINT_PTR kTimerId = 1;               // Timer ID
-  static constexpr UINT kTimerInterval = 100;           // Timer interval (milliseconds)
-  static constexpr UINT kTrayIconId = 1;                // Tray icon ID
-  static constexpr UINT kTrayIconMessage = WM_APP + 1;  // Tray message ID
-  static constexpr UINT kMenuExitId = 2000;             // Exit menu item ID
-  static constexpr UINT kMenuAutoStartId = 2001;        // Enable auto-start menu item ID
-  static constexpr UINT kMenuDisableAutoStartId = 2002; // Disable auto-start menu item ID
-
-  enum class MouseTrackingMode {
-    kHook,    // Use SetWindowsHookEx
-    kPolling  // Use GetCursorPos in WM_TIMER
-  };
-};
-
+#pragma comment(lib, "wtsapi32.lib")
 // clang-format on
 
-class Logger {
- public:
-  static Logger& GetInstance() {
-    static Logger instance;
-    return instance;
-  }
-
-  void Log(const std::string& message) {
-    std::ofstream log_file("ShakeToFindCursor.log", std::ios_base::app);
-    if (log_file.is_open()) {
-      log_file << GetTimestamp() << " - " << message << std::endl;
-    }
-  }
-
- private:
-  Logger() = default;
-  Logger(const Logger&) = delete;
-  Logger& operator=(const Logger&) = delete;
-
-  std::string GetTimestamp() {
-    auto now = std::chrono::system_clock::now();
-    auto now_time_t = std::chrono::system_clock::to_time_t(now);
-    std::tm now_tm;
-    localtime_s(&now_tm, &now_time_t);
-    std::stringstream ss;
-    ss << std::put_time(&now_tm, "%Y-%m-%d %H:%M:%S");
-    return ss.str();
-  }
-};
-
-#ifdef _DEBUG
-#define DEBUG_LOG(msg) Logger::GetInstance().Log(msg)
-#else
-#define DEBUG_LOG(msg)
-#endif
-
 // COM initialization class
 class ComInitializer {
  public:
@@ -96,51 +29,150 @@ class ComInitializer {
   ~ComInitializer() { CoUninitialize(); }
 };
 
-// Auto-start manager class to enable/disable auto-start
+// Auto-start manager class to enable/disable auto-start. The Task
+// Scheduler calls can take seconds, so they run on a dedicated STA thread
+// that keeps one connected ITaskService; the UI thread reads the cached
+// state and gets results back as posted messages.
 class AutoStartManager {
  public:
-  static bool IsAutoStartEnabled() {
-    CComPtr<ITaskService> task_service;
-    HRESULT hr = task_service.CoCreateInstance(CLSID_TaskScheduler, nullptr,
-                                               CLSCTX_INPROC_SERVER);
-    if (FAILED(hr)) return false;
+  enum class State { kUnknown, kEnabled, kDisabled };
+  enum class Command { kRefresh, kEnable, kDisable };
+
+  // Results of kEnable and kDisable are posted to hwnd as message, with the
+  // command in wParam and whether it succeeded in lParam
+  AutoStartManager(HWND hwnd, UINT message) : hwnd_(hwnd), message_(message) {
+    event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    if (!event_) {
+      throw std::runtime_error("Failed to create auto-start event");
+    }
+    commands_.push_back(Command::kRefresh);
+    running_ = true;
+    thread_ = std::thread(&AutoStartManager::WorkerThreadProc, this);
+  }
 
-    hr = task_service->Connect(_variant_t(), _variant_t(), _variant_t(),
-                               _variant_t());
-    if (FAILED(hr)) return false;
+  ~AutoStartManager() {
+    running_ = false;
+    SetEvent(event_);
+    if (thread_.joinable()) {
+      thread_.join();
+    }
+    CloseHandle(event_);
+  }
 
-    CComPtr<ITaskFolder> root_folder;
-    hr = task_service->GetFolder(_bstr_t(L"\\"), &root_folder);
-    if (FAILED(hr)) return false;
+  AutoStartManager(const AutoStartManager&) = delete;
+  AutoStartManager& operator=(const AutoStartManager&) = delete;
+
+  // kUnknown until the first query finishes and while a change is pending
+  State GetState() const { return state_.load(std::memory_order_acquire); }
+
+  void Post(Command command) {
+    if (command != Command::kRefresh) {
+      state_.store(State::kUnknown, std::memory_order_release);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      commands_.push_back(command);
+    }
+    SetEvent(event_);
+  }
+
+ private:
+  static constexpr const wchar_t* kTaskName = L"ShakeToFindCursor";
+
+  void WorkerThreadProc() {
+    if (FAILED(CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED))) {
+      ERROR_LOG("Failed to initialize COM for auto-start");
+      return;
+    }
+    while (running_) {
+      std::vector<Command> commands;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands.swap(commands_);
+      }
+      for (Command command : commands) {
+        Execute(command);
+      }
 
+      // An STA thread has to keep pumping messages while it waits
+      if (MsgWaitForMultipleObjects(1, &event_, FALSE, INFINITE,
+                                    QS_ALLINPUT) == WAIT_OBJECT_0 + 1) {
+        MSG msg;
+        while (PeekMessageW(&msg, nullptr, 0, 0, PM_REMOVE)) {
+          DispatchMessageW(&msg);
+        }
+      }
+    }
+    service_.Release();
+    CoUninitialize();
+  }
+
+  void Execute(Command command) {
+    CComPtr<ITaskFolder> root_folder = GetRootFolder();
+    bool succeeded = false;
+    if (root_folder) {
+      switch (command) {
+        case Command::kRefresh:
+          succeeded = true;
+          break;
+        case Command::kEnable:
+          succeeded = RegisterTask(root_folder);
+          break;
+        case Command::kDisable:
+          succeeded = SUCCEEDED(root_folder->DeleteTask(_bstr_t(kTaskName), 0));
+          break;
+      }
+    }
+
+    // Re-read the state after every change rather than assuming the outcome
+    State state = State::kDisabled;
     CComPtr<IRegisteredTask> task;
-    hr = root_folder->GetTask(_bstr_t(L"ShakeToFindCursor"), &task);
+    if (root_folder &&
+        SUCCEEDED(root_folder->GetTask(_bstr_t(kTaskName), &task)) && task) {
+      state = State::kEnabled;
+    }
+    state_.store(state, std::memory_order_release);
 
-    return SUCCEEDED(hr) && task != nullptr;
+    if (command != Command::kRefresh) {
+      PostMessageW(hwnd_, message_, static_cast<WPARAM>(command),
+                   succeeded ? 1 : 0);
+    }
   }
 
-  static bool EnableAutoStart() {
-    WCHAR exe_path[MAX_PATH];
-    if (!GetModuleFileNameW(nullptr, exe_path, MAX_PATH)) return false;
+  // Connects on first use and again after the service went away
+  CComPtr<ITaskFolder> GetRootFolder() {
+    CComPtr<ITaskFolder> root_folder;
+    if (service_ &&
+        SUCCEEDED(service_->GetFolder(_bstr_t(L"\\"), &root_folder))) {
+      return root_folder;
+    }
 
+    service_.Release();
     CComPtr<ITaskService> task_service;
     HRESULT hr = task_service.CoCreateInstance(CLSID_TaskScheduler, nullptr,
                                                CLSCTX_INPROC_SERVER);
-    if (FAILED(hr)) return false;
+    if (FAILED(hr)) return nullptr;
 
     hr = task_service->Connect(_variant_t(), _variant_t(), _variant_t(),
                                _variant_t());
-    if (FAILED(hr)) return false;
+    if (FAILED(hr)) return nullptr;
 
-    CComPtr<ITaskFolder> root_folder;
     hr = task_service->GetFolder(_bstr_t(L"\\"), &root_folder);
-    if (FAILED(hr)) return false;
+    if (FAILED(hr)) return nullptr;
+
+    service_ = task_service;
+    return root_folder;
+  }
+
+  bool RegisterTask(ITaskFolder* root_folder) {
+    WCHAR exe_path[MAX_PATH];
+    if (!GetModuleFileNameW(nullptr, exe_path, MAX_PATH)) return false;
 
     // Delete existing task if present
-    root_folder->DeleteTask(_bstr_t(L"ShakeToFindCursor"), 0);
+    root_folder->DeleteTask(_bstr_t(kTaskName), 0);
 
     CComPtr<ITaskDefinition> task;
-    hr = task_service->NewTask(0, &task);
+    HRESULT hr = service_->NewTask(0, &task);
     if (FAILED(hr)) return false;
 
     // Set general info
@@ -229,7 +261,7 @@ class AutoStartManager {
     // Register the task - use current user's credentials
     CComPtr<IRegisteredTask> registered_task;
     hr = root_folder->RegisterTaskDefinition(
-        _bstr_t(L"ShakeToFindCursor"), task, TASK_CREATE_OR_UPDATE,
+        _bstr_t(kTaskName), task, TASK_CREATE_OR_UPDATE,
         _variant_t(),                  // Default credentials (current user)
         _variant_t(),                  // Default password
         TASK_LOGON_INTERACTIVE_TOKEN,  // Run only when user is logged on
@@ -239,404 +271,110 @@ class AutoStartManager {
     return SUCCEEDED(hr);
   }
 
-  static bool DisableAutoStart() {
-    CComPtr<ITaskService> task_service;
-    HRESULT hr = task_service.CoCreateInstance(CLSID_TaskScheduler, nullptr,
-                                               CLSCTX_INPROC_SERVER);
-    if (FAILED(hr)) return false;
-
-    hr = task_service->Connect(_variant_t(), _variant_t(), _variant_t(),
-                               _variant_t());
-    if (FAILED(hr)) return false;
-
-    CComPtr<ITaskFolder> root_folder;
-    hr = task_service->GetFolder(_bstr_t(L"\\"), &root_folder);
-    if (FAILED(hr)) return false;
-
-    hr = root_folder->DeleteTask(_bstr_t(L"ShakeToFindCursor"), 0);
-    return SUCCEEDED(hr);
-  }
-};
-
-// Cursor utilities class
-class CursorUtils {
- public:
-  static HCURSOR ScaleCursor(HCURSOR src_cursor, double scale_factor) {
-    if (!src_cursor || scale_factor <= 0) {
-      return nullptr;
-    }
-
-    // Get cursor information
-    ICONINFO icon_info;
-    if (!GetIconInfo(src_cursor, &icon_info)) {
-      return nullptr;
-    }
-
-    // Use RAII to manage bitmap resources
-    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
-        color_bitmap(icon_info.hbmColor, DeleteObject);
-    std::unique_ptr<std::remove_pointer<HBITMAP>::type, decltype(&DeleteObject)>
-        mask_bitmap(icon_info.hbmMask, DeleteObject);
-
-    // Get bitmap information
-    BITMAP bm;
-    if (!GetObject(icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask,
-                   sizeof(BITMAP), &bm)) {
-      return nullptr;
-    }
-
-    // Calculate new dimensions
-    int new_width = static_cast<int>(bm.bmWidth * scale_factor);
-    int new_height = static_cast<int>(bm.bmHeight * scale_factor);
-
-    // Create compatible DC
-    HDC screen_dc = GetDC(nullptr);
-    if (!screen_dc) {
-      return nullptr;
-    }
-    HDC src_dc = CreateCompatibleDC(screen_dc);
-    HDC dst_dc = CreateCompatibleDC(screen_dc);
-    if (!src_dc || !dst_dc) {
-      if (src_dc) DeleteDC(src_dc);
-      if (dst_dc) DeleteDC(dst_dc);
-      ReleaseDC(nullptr, screen_dc);
-      return nullptr;
-    }
-
-    // Create new color bitmap and mask bitmap
-    HBITMAP new_color = nullptr;
-    HBITMAP new_mask = nullptr;
-    HCURSOR new_cursor = nullptr;
-
-    do {
-      // Create enlarged color bitmap
-      BITMAPINFO bmi = {0};
-      bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-      bmi.bmiHeader.biWidth = new_width;
-      bmi.bmiHeader.biHeight = new_height;
-      bmi.bmiHeader.biPlanes = 1;
-      bmi.bmiHeader.biBitCount = 32;
-      bmi.bmiHeader.biCompression = BI_RGB;
-
-      void* color_bits = nullptr;
-      new_color = CreateDIBSection(screen_dc, &bmi, DIB_RGB_COLORS, &color_bits,
-                                   nullptr, 0);
-      if (!new_color) break;
-
-      // Create mask bitmap
-      new_mask = CreateBitmap(new_width, new_height, 1, 1, nullptr);
-      if (!new_mask) break;
-
-      // Select source bitmap
-      HBITMAP old_src_color = (HBITMAP)SelectObject(
-          src_dc, icon_info.hbmColor ? icon_info.hbmColor : icon_info.hbmMask);
-      HBITMAP old_dst_color = (HBITMAP)SelectObject(dst_dc, new_color);
-
-      // Perform scaling
-      SetStretchBltMode(dst_dc, HALFTONE);
-      SetBrushOrgEx(dst_dc, 0, 0, nullptr);
-      StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0, bm.bmWidth,
-                 bm.bmHeight, SRCCOPY);
-
-      // If there is a color bitmap, also process the mask bitmap
-      if (icon_info.hbmColor) {
-        SelectObject(src_dc, icon_info.hbmMask);
-        SelectObject(dst_dc, new_mask);
-        StretchBlt(dst_dc, 0, 0, new_width, new_height, src_dc, 0, 0,
-                   bm.bmWidth, bm.bmHeight, SRCCOPY);
-      }
-
-      // Restore DC
-      SelectObject(src_dc, old_src_color);
-      SelectObject(dst_dc, old_dst_color);
-
-      // Create new cursor
-      ICONINFO new_icon_info = {0};
-      new_icon_info.fIcon =
-          FALSE;  // Specify creating a cursor instead of an icon
-      new_icon_info.xHotspot =
-          static_cast<DWORD>(icon_info.xHotspot * scale_factor);
-      new_icon_info.yHotspot =
-          static_cast<DWORD>(icon_info.yHotspot * scale_factor);
-      new_icon_info.hbmMask = new_mask;
-      new_icon_info.hbmColor = new_color;
-
-      new_cursor = CreateIconIndirect(&new_icon_info);
-
-    } while (false);
-
-    // Clean up resources
-    if (new_color) DeleteObject(new_color);
-    if (new_mask) DeleteObject(new_mask);
-    DeleteDC(src_dc);
-    DeleteDC(dst_dc);
-    ReleaseDC(nullptr, screen_dc);
-
-    return new_cursor;
-  }
+  HWND hwnd_;
+  UINT message_;
+  HANDLE event_ = nullptr;
+  std::mutex mutex_;
+  std::vector<Command> commands_;  // Guarded by mutex_
+  std::thread thread_;
+  std::atomic<bool> running_{false};
+  std::atomic<State> state_{State::kUnknown};
+  CComPtr<ITaskService> service_;  // Used by the worker thread only
 };
 
-HCURSOR GetSystemArrowCursor() {
-  CURSORINFO ci = {sizeof(CURSORINFO)};
-  if (GetCursorInfo(&ci)) {
-    return CopyCursor(ci.hCursor);
-  }
-  return nullptr;
-}
-
-// Large cursor class
-class LargeCursor {
+// Registers the calling thread with the Multimedia Class Scheduler
+// Service under a task such as "Games", which keeps its priority up on a
+// loaded machine. avrt.dll is loaded at run time, so without it the thread
+// just keeps its normal priority boost.
+class MmcssRegistration {
  public:
-  LargeCursor(LPCWSTR cursor_name, DWORD system_cursor_id)
-      : system_cursor_id_(system_cursor_id) {
-    // Load the system cursor
-    original_cursor_ = CopyCursor(LoadCursorW(nullptr, cursor_name));
-    if (!original_cursor_) {
-      throw std::runtime_error("Failed to load system cursor");
-    }
-
-    // Create enlarged cursor
-    large_cursor_ = CursorUtils::ScaleCursor(
-        original_cursor_, CursorConfig::kScaleFactor);  // Enlarge by 2 times
-    if (!large_cursor_) {
-      throw std::runtime_error("Failed to create large cursor");
+  explicit MmcssRegistration(const wchar_t* task) {
+    avrt_ = LoadLibraryW(L"avrt.dll");
+    if (!avrt_) return;
+    auto set_characteristics =
+        GetFunction<SetFunc>("AvSetMmThreadCharacteristicsW");
+    revert_ = GetFunction<RevertFunc>("AvRevertMmThreadCharacteristics");
+    DWORD task_index = 0;
+    if (set_characteristics && revert_) {
+      handle_ = set_characteristics(task, &task_index);
     }
-  }
-
-  void Enlarge() {
-    if (large_cursor_) {
-      HCURSOR cursor_copy = CopyCursor(large_cursor_);
-      if (cursor_copy) {
-        SetSystemCursor(cursor_copy, system_cursor_id_);
-      } else {
-        DestroyCursor(cursor_copy);
-      }
-    }
-  }
-
-  void Restore() {
-    if (original_cursor_) {
-      HCURSOR cursor_copy = CopyCursor(original_cursor_);
-      if (cursor_copy) {
-        SetSystemCursor(cursor_copy, system_cursor_id_);
-      } else {
-        DestroyCursor(cursor_copy);
-      }
+    if (!handle_) {
+      LOG_MESSAGE(LogLevel::kWarning, "MMCSS registration failed");
     }
   }
 
-  ~LargeCursor() {
-    if (original_cursor_) {
-      DestroyCursor(original_cursor_);
-    }
-    if (large_cursor_) {
-      DestroyCursor(large_cursor_);
-    }
+  ~MmcssRegistration() {
+    if (handle_) revert_(handle_);
+    if (avrt_) FreeLibrary(avrt_);
   }
 
- private:
-  DWORD system_cursor_id_;
-  HCURSOR original_cursor_ = nullptr;
-  HCURSOR large_cursor_ = nullptr;
-};
-
-// Large cursor manager class
-class LargeCursorManager {
- public:
-  LargeCursorManager() {
-    // Create large cursor for each system cursor
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_ARROW, OCR_NORMAL));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_IBEAM, OCR_IBEAM));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_WAIT, OCR_WAIT));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_CROSS, OCR_CROSS));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_UPARROW, OCR_UP));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENWSE, OCR_SIZENWSE));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENESW, OCR_SIZENESW));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZEWE, OCR_SIZEWE));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZENS, OCR_SIZENS));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_SIZEALL, OCR_SIZEALL));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_NO, OCR_NO));
-    large_cursors_.push_back(std::make_unique<LargeCursor>(IDC_HAND, OCR_HAND));
-    large_cursors_.push_back(
-        std::make_unique<LargeCursor>(IDC_APPSTARTING, OCR_APPSTARTING));
-  }
-
-  void EnlargeAll() {
-    for (const auto& cursor : large_cursors_) {
-      cursor->Enlarge();
-    }
-  }
-
-  void RestoreAll() {
-    for (const auto& cursor : large_cursors_) {
-      cursor->Restore();
-    }
-  }
+  MmcssRegistration(const MmcssRegistration&) = delete;
+  MmcssRegistration& operator=(const MmcssRegistration&) = delete;
 
  private:
-  std::vector<std::unique_ptr<LargeCursor>> large_cursors_;
-};
-
-// Cursor state management class
-class CursorState {
- public:
-  CursorState() {}
-
-  ~CursorState() {
-    DEBUG_LOG("CursorState destroyed");
-    // Use SystemParametersInfo to restore all system cursors
-    if (SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE)) {
-      is_enlarged_ = false;
-    }
-  }
-
-  void Enlarge() {
-    if (!is_enlarged_) {
-      // Enlarge all system cursors
-      large_cursor_manager_.EnlargeAll();
-      is_enlarged_ = true;
-      enlarge_start_time_ = std::chrono::high_resolution_clock::now();
-    }
-  }
-
-  void RestoreIfNeeded() {
-    if (is_enlarged_) {
-      auto now = std::chrono::high_resolution_clock::now();
-      auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
-                         now - enlarge_start_time_)
-                         .count();
-
-      if (elapsed > CursorConfig::kEnlargeDurationMs) {
-        RestoreOriginalCursor();
-      }
-    }
-  }
+  using SetFunc = HANDLE(WINAPI*)(LPCWSTR, LPDWORD);
+  using RevertFunc = BOOL(WINAPI*)(HANDLE);
 
- private:
-  void RestoreOriginalCursor() {
-    if (is_enlarged_) {
-      // Restore all system cursors
-      large_cursor_manager_.RestoreAll();
-      is_enlarged_ = false;
-    }
+  template <typename Func>
+  Func GetFunction(const char* name) const {
+    return reinterpret_cast<Func>(
+        reinterpret_cast<void*>(GetProcAddress(avrt_, name)));
   }
 
-  LargeCursorManager large_cursor_manager_;
-  bool is_enlarged_ = false;
-  std::chrono::high_resolution_clock::time_point enlarge_start_time_;
+  HMODULE avrt_ = nullptr;
+  RevertFunc revert_ = nullptr;
+  HANDLE handle_ = nullptr;
 };
 
-// Mouse movement detector class with shake pattern recognition
-class MouseMoveDetector {
- public:
-  MouseMoveDetector() {
-    GetCursorPos(&last_pos_);
-    last_time_ = std::chrono::high_resolution_clock::now();
-  }
-
-  bool ShouldEnlargeCursor(const POINT& current_pos) {
-    auto now = std::chrono::high_resolution_clock::now();
-    auto delta_time =
-        std::chrono::duration_cast<std::chrono::milliseconds>(now - last_time_)
-            .count();
-
-    if (delta_time <= 0) return false;
-
-    // Calculate movement vector
-    int dx = current_pos.x - last_pos_.x;
-    int dy = current_pos.y - last_pos_.y;
-
-    // Update position history
-    movement_history_.push_back({dx, dy, delta_time});
-    if (movement_history_.size() > CursorConfig::kHistorySize) {
-      movement_history_.pop_front();
-    }
-
-    last_pos_ = current_pos;
-    last_time_ = now;
-
-    return DetectShakePattern();
-  }
-
- private:
-  struct Movement {
-    int dx;
-    int dy;
-    long long dt;
-  };
-
-  bool DetectShakePattern() {
-    if (movement_history_.size() < CursorConfig::kHistorySize) return false;
-
-    int direction_changes = 0;
-    double total_speed = 0.0;
-    long long total_time = 0;
-
-    // Previous movement direction (-1: negative, 1: positive, 0: neutral)
-    int last_x_dir = 0;
-    int last_y_dir = 0;
-
-    for (const auto& mov : movement_history_) {
-      // Calculate current direction
-      int curr_x_dir = (mov.dx > 0) ? 1 : (mov.dx < 0) ? -1 : 0;
-      int curr_y_dir = (mov.dy > 0) ? 1 : (mov.dy < 0) ? -1 : 0;
-
-      // Count direction changes
-      if (last_x_dir != 0 && curr_x_dir != 0 && last_x_dir != curr_x_dir) {
-        direction_changes++;
-      }
-      if (last_y_dir != 0 && curr_y_dir != 0 && last_y_dir != curr_y_dir) {
-        direction_changes++;
-      }
+// ShakeToFindCursor.ini next to the executable
+std::wstring GetConfigPath() {
+  wchar_t exe_path[MAX_PATH];
+  if (!GetModuleFileNameW(nullptr, exe_path, MAX_PATH)) return L"";
+  std::wstring path(exe_path);
+  return path.substr(0, path.find_last_of(L'\\') + 1) +
+         L"ShakeToFindCursor.ini";
+}
 
-      // Update last direction
-      last_x_dir = curr_x_dir;
-      last_y_dir = curr_y_dir;
+bool IsRunAsAdmin() {
+  BOOL is_admin = FALSE;
+  PSID admin_group = nullptr;
+  SID_IDENTIFIER_AUTHORITY nt_authority = SECURITY_NT_AUTHORITY;
 
-      // Calculate speed
-      double distance = std::sqrt(mov.dx * mov.dx + mov.dy * mov.dy);
-      double speed = (mov.dt > 0) ? (distance / mov.dt) * 1000.0 : 0;
-      total_speed += speed;
-      total_time += mov.dt;
+  if (AllocateAndInitializeSid(&nt_authority, 2, SECURITY_BUILTIN_DOMAIN_RID,
+                               DOMAIN_ALIAS_RID_ADMINS, 0, 0, 0, 0, 0, 0,
+                               &admin_group)) {
+    if (!CheckTokenMembership(nullptr, admin_group, &is_admin)) {
+      is_admin = FALSE;
     }
-
-    // Check if we're within the time window
-    if (total_time > CursorConfig::kMaxTimeWindow) return false;
-
-    // Calculate average speed
-    double avg_speed = total_speed / movement_history_.size();
-
-    // Return true if we have enough direction changes and sufficient speed
-    return direction_changes >= CursorConfig::kMinDirectionChanges &&
-           avg_speed >= CursorConfig::kMinMovementSpeed;
+    FreeSid(admin_group);
   }
-
-  POINT last_pos_;
-  std::chrono::high_resolution_clock::time_point last_time_;
-  std::deque<Movement> movement_history_;
-};
+  return is_admin != FALSE;
+}
 
 class ShakeToFindCursor {
  public:
+  // Also how a second instance finds the running one
+  static constexpr LPCWSTR kWindowClassName = L"ShakeToFindCursorClass";
+
   static ShakeToFindCursor& GetInstance() {
     static ShakeToFindCursor instance;
     return instance;
   }
 
-  bool Initialize(CursorConfig::MouseTrackingMode mode) {
+  // A non-empty record_path records every sample to that trace file
+  bool Initialize(CursorConfig::MouseTrackingMode mode,
+                  CursorConfig::RenderMode render_mode,
+                  const std::wstring& record_path,
+                  std::unique_ptr<MouseMoveDetector> detector) {
     if (FAILED(CoInitializeEx(nullptr, COINIT_MULTITHREADED))) {
       throw std::runtime_error("Failed to initialize COM");
     }
     tracking_mode_ = mode;
+    move_detector_ = std::move(detector);
+    cursor_state_.SetRenderMode(render_mode);
+    if (!record_path.empty()) {
+      recorder_ = std::make_unique<MouseTraceWriter>(record_path);
+    }
 
     // Register window class
     WNDCLASSEXW wc = {0};
@@ -644,14 +382,14 @@ class ShakeToFindCursor {
     wc.lpfnWndProc = WindowProc;
     wc.hInstance = GetModuleHandle(nullptr);
     wc.hIcon = LoadIcon(wc.hInstance, MAKEINTRESOURCE(IDI_APP_ICON));
-    wc.lpszClassName = L"ShakeToFindCursorClass";
+    wc.lpszClassName = kWindowClassName;
 
     if (!RegisterClassExW(&wc)) {
       throw std::runtime_error("Failed to register window class");
     }
 
     // Create hidden window
-    hwnd_ = CreateWindowW(L"ShakeToFindCursorClass", L"ShakeToFindCursor",
+    hwnd_ = CreateWindowW(kWindowClassName, L"ShakeToFindCursor",
                           WS_OVERLAPPED, CW_USEDEFAULT, CW_USEDEFAULT, 0, 0,
                           nullptr, nullptr, GetModuleHandle(nullptr), nullptr);
 
@@ -662,29 +400,73 @@ class ShakeToFindCursor {
     // Set window instance pointer
     SetWindowLongPtr(hwnd_, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
 
-    // Create timer with different interval based on mode
-    UINT timer_interval =
-        (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling)
-            ? 10  // Poll more frequently when using timer
-            : CursorConfig::kTimerInterval;
+    // A second instance may be unelevated while this one needs admin
+    // rights, so let its forwarded command line through UIPI
+    ChangeWindowMessageFilterEx(hwnd_, WM_COPYDATA, MSGFLT_ALLOW, nullptr);
 
-    if (!SetTimer(hwnd_, CursorConfig::kTimerId, timer_interval, nullptr)) {
-      DestroyWindow(hwnd_);
-      throw std::runtime_error("Failed to create timer");
-    }
+    // Starts querying the current state right away so the tray menu has it
+    auto_start_ = std::make_unique<AutoStartManager>(
+        hwnd_, CursorConfig::kAutoStartResultMessage);
 
-    // Only install hook if using hook mode
-    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kHook) {
-      mouse_hook_ =
-          SetWindowsHookEx(WH_MOUSE_LL, MouseProc, GetModuleHandle(nullptr), 0);
+    if (recorder_ &&
+        !RegisterHotKey(hwnd_, CursorConfig::kLabelHotkeyId,
+                        CursorConfig::kLabelHotkeyModifiers,
+                        CursorConfig::kLabelHotkeyKey)) {
+      LOG_MESSAGE(LogLevel::kWarning,
+                  "Shake label hotkey unavailable; recording without labels");
+    }
 
-      if (!mouse_hook_) {
-        KillTimer(hwnd_, CursorConfig::kTimerId);
-        DestroyWindow(hwnd_);
-        throw std::runtime_error("Failed to install mouse hook");
+    // Set up before input starts, since the detection thread reports
+    // counter changes to it. Nothing runs on a timer while the counters
+    // stay put, and threshold changes arrive through the agent's event.
+    if constexpr (CursorConfig::kPublishSharedStats) {
+      try {
+        shared_stats_ = std::make_unique<SharedStatsPublisher>();
+        if (!RegisterWaitForSingleObject(
+                &control_wait_, shared_stats_->ControlEvent(),
+                SharedControlProc, this, INFINITE, WT_EXECUTEINWAITTHREAD)) {
+          throw std::runtime_error("Failed to wait for the control event");
+        }
+        PublishStats();
+      } catch (const std::exception& e) {
+        shared_stats_.reset();
+        LOG_MESSAGE(LogLevel::kWarning,
+                    std::string("Shared stats unavailable: ") + e.what());
       }
     }
 
+    try {
+      StartInputThread();
+    } catch (...) {
+      StopSharedStats();
+      DestroyWindow(hwnd_);
+      throw;
+    }
+
+    // Input is switched off while it cannot reach this session's desktop.
+    // Sleep and resume arrive as WM_POWERBROADCAST without registering.
+    if (!WTSRegisterSessionNotification(hwnd_, NOTIFY_FOR_THIS_SESSION)) {
+      LOG_MESSAGE(LogLevel::kWarning,
+                  "Session notifications unavailable; input stays on while "
+                  "locked");
+    }
+    if constexpr (CursorConfig::kSuspendInFullscreen) {
+      // Fullscreen apps are checked when the foreground window changes,
+      // when the display mode changes and when the shell tells appbars a
+      // window went fullscreen in place, as on F11. None of these fire on
+      // mouse moves, and nothing runs on a timer.
+      foreground_hook_ = SetWinEventHook(
+          EVENT_SYSTEM_FOREGROUND, EVENT_SYSTEM_FOREGROUND, nullptr,
+          ForegroundProc, 0, 0,
+          WINEVENT_OUTOFCONTEXT | WINEVENT_SKIPOWNPROCESS);
+      // An appbar that never sets its position reserves no screen space
+      APPBARDATA appbar = {sizeof(APPBARDATA)};
+      appbar.hWnd = hwnd_;
+      appbar.uCallbackMessage = CursorConfig::kAppBarMessage;
+      appbar_registered_ = SHAppBarMessage(ABM_NEW, &appbar) != FALSE;
+      CheckFullscreen();
+    }
+
     // Set Ctrl+C handler
     SetConsoleCtrlHandler(ConsoleCtrlHandler, TRUE);
 
@@ -699,7 +481,10 @@ class ShakeToFindCursor {
     wcscpy_s(nid.szTip, L"Shake to Find Cursor");
 
     if (!Shell_NotifyIconW(NIM_ADD, &nid)) {
-      KillTimer(hwnd_, CursorConfig::kTimerId);
+      StopInputThread();
+      StopSharedStats();
+      StopFullscreenTracking();
+      WTSUnRegisterSessionNotification(hwnd_);
       DestroyWindow(hwnd_);
       throw std::runtime_error("Failed to create tray icon");
     }
@@ -713,20 +498,16 @@ class ShakeToFindCursor {
     MSG msg;
     running_ = true;
 
+    // Block in GetMessage until there is work to do; only the tray, the
+    // label hotkey and the WM_QUIT posted by Stop() wake this thread
     while (running_) {
-      // Use PeekMessage instead of GetMessage to handle timers even when there
-      // are no messages
-      while (PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE)) {
-        if (msg.message == WM_QUIT) {
-          running_ = false;
-          break;
-        }
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+      BOOL result = GetMessage(&msg, nullptr, 0, 0);
+      if (result == 0 || result == -1) {
+        running_ = false;
+        break;
       }
-
-      // Yield CPU time slice
-      Sleep(1);
+      TranslateMessage(&msg);
+      DispatchMessage(&msg);
     }
   }
 
@@ -739,21 +520,45 @@ class ShakeToFindCursor {
 
   ~ShakeToFindCursor() {
     RemoveTrayIcon();
-    if (mouse_hook_) {
-      UnhookWindowsHookEx(mouse_hook_);
+    StopFullscreenTracking();
+    StopInputThread();
+    StopSharedStats();
+    if (recorder_) {
+      LOG_MESSAGE(LogLevel::kInfo, "Recorded " +
+                                       std::to_string(recorder_->Size()) +
+                                       " samples");
+      recorder_.reset();
     }
+    auto_start_.reset();
     if (hwnd_) {
-      KillTimer(hwnd_, CursorConfig::kTimerId);
+      WTSUnRegisterSessionNotification(hwnd_);
+      UnregisterHotKey(hwnd_, CursorConfig::kLabelHotkeyId);
       DestroyWindow(hwnd_);
     }
     SetConsoleCtrlHandler(ConsoleCtrlHandler, FALSE);
     CoUninitialize();
   }
 
-  void ProcessMouseMove(const MSLLHOOKSTRUCT* mouse_info) {
-    if (move_detector_.ShouldEnlargeCursor(mouse_info->pt)) {
-      cursor_state_.Enlarge();
+  void ProcessMouseMove(const MouseSample& sample) {
+    Record(&sample, 1);
+    bool triggered;
+    {
+      ScopedLatency detection(LatencyStats::Histogram::kDetection);
+      triggered = move_detector_->ShouldEnlargeCursor(sample);
+    }
+    OnSamplesProcessed(1, triggered ? &sample : nullptr);
+  }
+
+  void ProcessMouseBatch(const MouseSample* samples, size_t count) {
+    Record(samples, count);
+    size_t trigger;
+    {
+      ScopedLatency detection(LatencyStats::Histogram::kDetection);
+      trigger = move_detector_->ProcessBatch(samples, count);
     }
+    OnSamplesProcessed(count, trigger != MouseMoveDetector::kNoTrigger
+                                  ? &samples[trigger]
+                                  : nullptr);
   }
 
  private:
@@ -761,32 +566,709 @@ class ShakeToFindCursor {
   ShakeToFindCursor(const ShakeToFindCursor&) = delete;
   ShakeToFindCursor& operator=(const ShakeToFindCursor&) = delete;
 
+  // Why mouse input is currently switched off; any number may hold at once
+  enum SuspendReason : unsigned {
+    kSuspendLocked = 1 << 0,
+    kSuspendDisconnected = 1 << 1,
+    kSuspendSleeping = 1 << 2,
+    kSuspendFullscreen = 1 << 3,
+  };
+
+  // Runs on whichever thread does the detection, which is the only one
+  // feeding samples in any tracking mode
+  void Record(const MouseSample* samples, size_t count) {
+    if (recorder_) {
+      recorder_->Write(samples, count,
+                       shake_label_.load(std::memory_order_relaxed)
+                           ? MouseTraceRecord::kShakeLabel
+                           : 0);
+    }
+  }
+
+  void OnSamplesProcessed(size_t count, const MouseSample* trigger) {
+    LatencyStats& stats = LatencyStats::GetInstance();
+    stats.Add(LatencyStats::Counter::kSamplesProcessed, count);
+    static constexpr LatencyStats::Counter kSourceCounters[] = {
+        LatencyStats::Counter::kHookSamples,
+        LatencyStats::Counter::kPollingSamples,
+        LatencyStats::Counter::kRawInputSamples};
+    stats.Add(kSourceCounters[static_cast<size_t>(tracking_mode_)], count);
+    if (trigger) {
+      stats.Add(LatencyStats::Counter::kTriggers);
+      cursor_state_.Enlarge(
+          trigger->timestamp_us,
+          CursorConfig::ZoomLevelForIntensity(move_detector_->Intensity()));
+    }
+    // One message per publish, however many samples arrive in between
+    if (shared_stats_ && (count || trigger) &&
+        !stats_changed_.load(std::memory_order_relaxed) &&
+        !stats_changed_.exchange(true, std::memory_order_relaxed)) {
+      PostMessage(hwnd_, CursorConfig::kStatsChangedMessage, 0, 0);
+    }
+  }
+
+  // The hook, raw input and the polling timer all belong to the thread that
+  // set them up, so they live here rather than on the UI thread, where a
+  // message box or the tray menu could hold them up
+  void InputThreadProc(std::promise<void>* ready) {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST);
+    std::unique_ptr<MmcssRegistration> mmcss;
+    if constexpr (CursorConfig::kInputThreadMmcss) {
+      mmcss = std::make_unique<MmcssRegistration>(L"Games");
+    }
+
+    input_thread_id_ = GetCurrentThreadId();
+    try {
+      StartInput();
+    } catch (...) {
+      StopInput();
+      ready->set_exception(std::current_exception());
+      return;
+    }
+    ready->set_value();
+
+    // Ends with the WM_QUIT posted by StopInputThread
+    MSG msg;
+    while (GetMessage(&msg, nullptr, 0, 0) > 0) {
+      DispatchMessage(&msg);
+    }
+    StopInput();
+  }
+
+  // Starts the input thread and waits until it is set up, so that its
+  // errors surface here
+  void StartInputThread() {
+    std::promise<void> input_ready;
+    std::future<void> input_started = input_ready.get_future();
+    input_thread_ =
+        std::thread(&ShakeToFindCursor::InputThreadProc, this, &input_ready);
+    try {
+      input_started.get();
+    } catch (...) {
+      input_thread_.join();
+      throw;
+    }
+  }
+
+  void StartInput() {
+    // Movement from before a suspension must not count towards a shake
+    POINT pt = {0, 0};
+    GetCursorPos(&pt);
+    move_detector_->Reset(
+        {pt, HighResClock::NowMicroseconds(), tracking_mode_, nullptr});
+    mouse_history_.Reset();
+    MouseSample stale;
+    while (sample_queue_.Pop(stale)) continue;
+
+    WNDCLASSEXW wc = {sizeof(WNDCLASSEXW)};
+    wc.lpfnWndProc = InputWindowProc;
+    wc.hInstance = GetModuleHandle(nullptr);
+    wc.lpszClassName = L"ShakeToFindCursorInputClass";
+    RegisterClassExW(&wc);
+
+    // Message-only window for the timer and raw input
+    input_hwnd_ = CreateWindowExW(0, wc.lpszClassName, L"", 0, 0, 0, 0, 0,
+                                  HWND_MESSAGE, nullptr, wc.hInstance,
+                                  nullptr);
+    if (!input_hwnd_) {
+      throw std::runtime_error("Failed to create input window");
+    }
+    SetWindowLongPtr(input_hwnd_, GWLP_USERDATA,
+                     reinterpret_cast<LONG_PTR>(this));
+
+    // Only polling mode needs a timer; the cursor animation runs on its own
+    // thread so an idle process never wakes up
+    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling &&
+        !SetTimer(input_hwnd_, CursorConfig::kTimerId,
+                  polling_scheduler_.Period(), nullptr)) {
+      throw std::runtime_error("Failed to create timer");
+    }
+
+    // Register for raw mouse input, delivered even while in the background
+    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kRawInput) {
+      BOOL is_wow64 = FALSE;
+      IsWow64Process(GetCurrentProcess(), &is_wow64);
+      raw_input_wow64_ = is_wow64 != FALSE;
+      POINT cursor = {0, 0};
+      GetCursorPos(&cursor);
+      raw_x_ = cursor.x;
+      raw_y_ = cursor.y;
+
+      RAWINPUTDEVICE rid = {0};
+      rid.usUsagePage = 0x01;  // HID_USAGE_PAGE_GENERIC
+      rid.usUsage = 0x02;      // HID_USAGE_GENERIC_MOUSE
+      rid.dwFlags = RIDEV_INPUTSINK;
+      rid.hwndTarget = input_hwnd_;
+
+      if (!RegisterRawInputDevices(&rid, 1, sizeof(rid))) {
+        throw std::runtime_error("Failed to register raw input device");
+      }
+      raw_input_registered_ = true;
+    }
+
+    // Only install hook if using hook mode
+    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kHook) {
+      // The hook only queues samples; detection and cursor changes run on a
+      // separate thread so the hook callback returns immediately
+      sample_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+      if (!sample_event_) {
+        throw std::runtime_error("Failed to create sample event");
+      }
+      detection_running_ = true;
+      detection_thread_ = std::thread(&ShakeToFindCursor::DetectionThreadProc,
+                                      this);
+
+      mouse_hook_ =
+          SetWindowsHookEx(WH_MOUSE_LL, MouseProc, GetModuleHandle(nullptr), 0);
+
+      if (!mouse_hook_) {
+        throw std::runtime_error("Failed to install mouse hook");
+      }
+    }
+  }
+
+  // Undoes whatever StartInput got to; runs on the input thread
+  void StopInput() {
+    if (mouse_hook_) {
+      UnhookWindowsHookEx(mouse_hook_);
+      mouse_hook_ = nullptr;
+    }
+    StopDetectionThread();
+    if (sample_event_) {
+      CloseHandle(sample_event_);
+      sample_event_ = nullptr;
+    }
+    if (raw_input_registered_) {
+      RAWINPUTDEVICE rid = {0};
+      rid.usUsagePage = 0x01;  // HID_USAGE_PAGE_GENERIC
+      rid.usUsage = 0x02;      // HID_USAGE_GENERIC_MOUSE
+      rid.dwFlags = RIDEV_REMOVE;
+      RegisterRawInputDevices(&rid, 1, sizeof(rid));
+      raw_input_registered_ = false;
+    }
+    if (input_hwnd_) {
+      KillTimer(input_hwnd_, CursorConfig::kTimerId);
+      DestroyWindow(input_hwnd_);
+      input_hwnd_ = nullptr;
+    }
+    if (tracking_mode_ == CursorConfig::MouseTrackingMode::kPolling) {
+      LogPollingStats("Polling stopped");
+    }
+  }
+
+  void StopInputThread() {
+    if (input_thread_.joinable()) {
+      PostThreadMessageW(input_thread_id_, WM_QUIT, 0, 0);
+      input_thread_.join();
+    }
+  }
+
+  // Input is torn down while any reason holds and set up again once none
+  // does. Runs on the UI thread.
+  void SetSuspended(SuspendReason reason, bool suspended) {
+    const unsigned previous = suspend_reasons_;
+    if (suspended) {
+      suspend_reasons_ |= reason;
+    } else {
+      suspend_reasons_ &= ~static_cast<unsigned>(reason);
+    }
+    if ((previous == 0) == (suspend_reasons_ == 0)) return;
+
+    if (suspend_reasons_) {
+      LOG_MESSAGE(LogLevel::kInfo, "Input suspended");
+      StopInputThread();
+    } else {
+      LOG_MESSAGE(LogLevel::kInfo, "Input resumed");
+      ResumeInput();
+    }
+    if (shared_stats_) PublishStats();
+  }
+
+  void ResumeInput() {
+    try {
+      StartInputThread();
+    } catch (const std::exception& e) {
+      LOG_MESSAGE(LogLevel::kError,
+                  std::string("Failed to resume input: ") + e.what());
+    }
+  }
+
+  void PublishStats() {
+    shared_stats_->Publish(suspend_reasons_, move_detector_->Thresholds());
+  }
+
+  // Runs on a thread pool wait thread
+  static void CALLBACK SharedControlProc(PVOID context, BOOLEAN) {
+    auto* instance = static_cast<ShakeToFindCursor*>(context);
+    // An agent may have created the event with manual reset
+    ResetEvent(instance->shared_stats_->ControlEvent());
+    PostMessage(instance->hwnd_, CursorConfig::kSharedControlMessage, 0, 0);
+  }
+
+  // Waits for SharedControlProc to finish before the publisher goes
+  void StopSharedStats() {
+    if (control_wait_) {
+      UnregisterWaitEx(control_wait_, INVALID_HANDLE_VALUE);
+      control_wait_ = nullptr;
+    }
+    if (hwnd_) KillTimer(hwnd_, CursorConfig::kStatsTimerId);
+    shared_stats_.reset();
+  }
+
+  // The input thread is the only user of the detector and the tracking
+  // mode, so it is stopped while change swaps them
+  template <typename Change>
+  void WithInputStopped(Change change) {
+    const bool running = suspend_reasons_ == 0;
+    if (running) StopInputThread();
+    change();
+    if (running) ResumeInput();
+  }
+
+  // Swaps in a detector with the thresholds the agent asked for
+  void ApplySharedControl() {
+    RuntimeShakeConfig thresholds;
+    if (!shared_stats_->TakeControl(&thresholds)) return;
+    LOG_MESSAGE(LogLevel::kInfo, "Detector thresholds changed remotely");
+    WithInputStopped([&] {
+      move_detector_ = MouseMoveDetector::Create(
+          MouseMoveDetector::Preset::kCustom, thresholds);
+    });
+  }
+
+  // Applies the command line of a later instance: a tracking mode option
+  // switches modes, and with a mode option or --preset the detector is
+  // reloaded from the configuration file. Any of those or --overlay also
+  // sets the render mode as a first launch would, the overlay with
+  // --overlay and the system cursors without. A bare duplicate launch
+  // changes nothing, so thresholds set through the shared control block
+  // survive it.
+  void ApplyCommandLine(const std::wstring& command_line) {
+    int argc = 0;
+    LPWSTR* argv = CommandLineToArgvW(command_line.c_str(), &argc);
+    if (!argv) return;
+    CursorConfig::MouseTrackingMode mode = tracking_mode_;
+    bool reload = false;
+    bool overlay = false;
+    std::wstring preset;
+    for (int i = 1; i < argc; ++i) {
+      if (wcscmp(argv[i], L"--hook") == 0) {
+        mode = CursorConfig::MouseTrackingMode::kHook;
+        reload = true;
+      } else if (wcscmp(argv[i], L"--rawinput") == 0) {
+        mode = CursorConfig::MouseTrackingMode::kRawInput;
+        reload = true;
+      } else if (wcscmp(argv[i], L"--polling") == 0) {
+        mode = CursorConfig::MouseTrackingMode::kPolling;
+        reload = true;
+      } else if (wcscmp(argv[i], L"--overlay") == 0) {
+        overlay = true;
+      } else if (wcscmp(argv[i], L"--debuglog") == 0) {
+        Logger::GetInstance().SetLevel(LogLevel::kDebug);
+      } else if (wcscmp(argv[i], L"--preset") == 0 && i + 1 < argc) {
+        preset = argv[++i];
+        reload = true;
+      }
+    }
+    LocalFree(argv);
+
+    if (overlay) {
+      cursor_state_.SetRenderMode(CursorConfig::RenderMode::kOverlay);
+    } else if (reload) {
+      // Only the overlay works without administrator rights
+      if (IsRunAsAdmin()) {
+        cursor_state_.SetRenderMode(CursorConfig::RenderMode::kSystemCursor);
+      } else {
+        LOG_MESSAGE(LogLevel::kWarning,
+                    "Keeping the overlay: system cursors need administrator "
+                    "rights");
+      }
+    }
+
+    std::unique_ptr<MouseMoveDetector> detector;
+    if (reload) {
+      try {
+        detector = MouseMoveDetector::Load(GetConfigPath(), preset);
+      } catch (const std::exception& e) {
+        LOG_MESSAGE(LogLevel::kError,
+                    std::string("Keeping the current detector: ") + e.what());
+      }
+    }
+    if (mode == tracking_mode_ && !detector) return;
+    LOG_MESSAGE(LogLevel::kInfo, "Applying command line of a new instance");
+    WithInputStopped([&] {
+      tracking_mode_ = mode;
+      if (detector) move_detector_ = std::move(detector);
+    });
+    if (shared_stats_) PublishStats();
+  }
+
+  // Fullscreen games, videos and presentations hide the cursor or own the
+  // mouse, so a shake cannot be meant for us
+  void CheckFullscreen() {
+    QUERY_USER_NOTIFICATION_STATE state;
+    if (FAILED(SHQueryUserNotificationState(&state))) return;
+    SetSuspended(kSuspendFullscreen,
+                 state == QUNS_BUSY || state == QUNS_RUNNING_D3D_FULL_SCREEN ||
+                     state == QUNS_PRESENTATION_MODE);
+  }
+
+  void StopFullscreenTracking() {
+    if (foreground_hook_) {
+      UnhookWinEvent(foreground_hook_);
+      foreground_hook_ = nullptr;
+    }
+    if (appbar_registered_) {
+      APPBARDATA appbar = {sizeof(APPBARDATA)};
+      appbar.hWnd = hwnd_;
+      SHAppBarMessage(ABM_REMOVE, &appbar);
+      appbar_registered_ = false;
+    }
+  }
+
+  static void CALLBACK ForegroundProc(HWINEVENTHOOK, DWORD, HWND, LONG,
+                                      LONG, DWORD, DWORD) {
+    GetInstance().CheckFullscreen();
+  }
+
+  static LRESULT CALLBACK InputWindowProc(HWND hwnd, UINT msg, WPARAM wParam,
+                                          LPARAM lParam) {
+    auto* instance = reinterpret_cast<ShakeToFindCursor*>(
+        GetWindowLongPtr(hwnd, GWLP_USERDATA));
+
+    switch (msg) {
+      case WM_TIMER:
+        if (wParam == CursorConfig::kTimerId && instance) {
+          if (instance->tracking_mode_ ==
+              CursorConfig::MouseTrackingMode::kPolling) {
+            instance->PollCursor();
+          }
+        }
+        return 0;
+
+      case WM_INPUT:
+        if (instance) {
+          instance->ProcessRawInput(reinterpret_cast<HRAWINPUT>(lParam));
+        }
+        // DefWindowProc performs the cleanup required for WM_INPUT
+        break;
+    }
+
+    return DefWindowProc(hwnd, msg, wParam, lParam);
+  }
+
+  void PollCursor() {
+    LatencyStats::GetInstance().Add(LatencyStats::Counter::kTimerWakeups);
+    POINT pt;
+    GetCursorPos(&pt);
+    long long now = HighResClock::NowMicroseconds();
+
+    // Reversals between two ticks only show up in the mouse history
+    int count = mouse_history_.Read(pt, now, polling_samples_);
+    if (count >= 0) {
+      ProcessMouseBatch(polling_samples_, static_cast<size_t>(count));
+    } else {
+      ProcessMouseMove(
+          {pt, now, CursorConfig::MouseTrackingMode::kPolling, nullptr});
+    }
+
+    if (polling_scheduler_.OnSample(pt, now)) {
+      // Re-arming an existing timer id just changes its period
+      SetTimer(input_hwnd_, CursorConfig::kTimerId,
+               polling_scheduler_.Period(), nullptr);
+      LogPollingStats("Polling period changed");
+    }
+  }
+
+  void LogPollingStats(const char* event) {
+    if (!Logger::GetInstance().IsEnabled(LogLevel::kDebug)) return;
+    PollingScheduler::Stats stats = polling_scheduler_.GetStats();
+    std::stringstream ss;
+    ss << event << ": period " << stats.period_ms << " ms, " << stats.wakeups
+       << " wakeups (" << stats.fast_wakeups << " fast), "
+       << stats.period_changes << " period changes";
+    DEBUG_LOG(ss.str());
+  }
+
   static LRESULT CALLBACK MouseProc(int nCode, WPARAM wParam, LPARAM lParam) {
     if (nCode == HC_ACTION && wParam == WM_MOUSEMOVE) {
+      ScopedLatency latency(LatencyStats::Histogram::kHookCallback);
       auto& instance = GetInstance();
-      instance.ProcessMouseMove(reinterpret_cast<MSLLHOOKSTRUCT*>(lParam));
+      instance.QueueMouseMove(reinterpret_cast<MSLLHOOKSTRUCT*>(lParam)->pt);
     }
     return CallNextHookEx(nullptr, nCode, wParam, lParam);
   }
 
+  // The timestamp is taken on arrival because MSLLHOOKSTRUCT::time only has
+  // millisecond resolution
+  void QueueMouseMove(const POINT& pt) {
+    if (!sample_queue_.Push({pt, HighResClock::NowMicroseconds(),
+                             CursorConfig::MouseTrackingMode::kHook,
+                             nullptr})) {
+      LatencyStats::GetInstance().Add(LatencyStats::Counter::kSamplesDropped);
+    }
+    // Only pay for SetEvent when the detection thread is actually asleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (detection_waiting_.exchange(false, std::memory_order_relaxed)) {
+      SetEvent(sample_event_);
+    }
+  }
+
+  void DetectionThreadProc() {
+    MouseSample samples[CursorConfig::kDetectionBatchSize];
+    while (detection_running_) {
+      while (size_t count = sample_queue_.PopBatch(
+                 samples, CursorConfig::kDetectionBatchSize)) {
+        ProcessMouseBatch(samples, count);
+      }
+
+      // Announce the wait before re-checking the queue so that a sample
+      // pushed in between always signals the event
+      detection_waiting_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (sample_queue_.Empty() && detection_running_) {
+        WaitForSingleObject(sample_event_, INFINITE);
+      }
+      detection_waiting_.store(false, std::memory_order_relaxed);
+    }
+  }
+
+  void StopDetectionThread() {
+    if (detection_thread_.joinable()) {
+      detection_running_ = false;
+      SetEvent(sample_event_);
+      detection_thread_.join();
+    }
+  }
+
+  void ProcessRawInput(HRAWINPUT raw_input) {
+    // The message being dispatched has already left the queue, so read it
+    // directly before draining whatever else has been buffered
+    RAWINPUT input;
+    UINT size = sizeof(input);
+    if (GetRawInputData(raw_input, RID_INPUT, &input, &size,
+                        sizeof(RAWINPUTHEADER)) != static_cast<UINT>(-1) &&
+        input.header.dwType == RIM_TYPEMOUSE) {
+      AddRawMouse(input.header.hDevice, input.data.mouse);
+    }
+
+    // 32-bit processes on 64-bit Windows receive 64-bit headers aligned to
+    // 8 bytes, so NEXTRAWINPUTBLOCK cannot be used as is
+    const size_t header_size =
+        raw_input_wow64_ ? sizeof(RAWINPUTHEADER) + 8 : sizeof(RAWINPUTHEADER);
+    const ULONG_PTR alignment = raw_input_wow64_ ? 8 : sizeof(ULONG_PTR);
+
+    for (;;) {
+      size = sizeof(raw_input_buffer_);
+      UINT count = GetRawInputBuffer(
+          reinterpret_cast<PRAWINPUT>(raw_input_buffer_), &size,
+          sizeof(RAWINPUTHEADER));
+      if (count == 0 || count == static_cast<UINT>(-1)) break;
+
+      const BYTE* block = reinterpret_cast<const BYTE*>(raw_input_buffer_);
+      for (UINT i = 0; i < count; ++i) {
+        const auto* header = reinterpret_cast<const RAWINPUTHEADER*>(block);
+        if (header->dwType == RIM_TYPEMOUSE) {
+          AddRawMouse(header->hDevice,
+                      *reinterpret_cast<const RAWMOUSE*>(block + header_size));
+        }
+        block = reinterpret_cast<const BYTE*>(
+            (reinterpret_cast<ULONG_PTR>(block) + header->dwSize +
+             alignment - 1) &
+            ~(alignment - 1));
+      }
+    }
+    FlushRawMouseBatch();
+  }
+
+  struct RawMousePacket {
+    HANDLE device;
+    RAWMOUSE mouse;
+  };
+
+  void AddRawMouse(HANDLE device, const RAWMOUSE& mouse) {
+    if (raw_batch_size_ == CursorConfig::kRawInputBatchSize) {
+      FlushRawMouseBatch();
+    }
+    raw_batch_[raw_batch_size_++] = {device, mouse};
+  }
+
+  // Raw input packets carry no timestamps of their own, so the packets of a
+  // batch are spread evenly over the time since the previous batch, bounded
+  // by the shortest report interval a mouse uses.
+  // Relative packets count device units (mickeys) before pointer speed and
+  // acceleration apply. They are scaled by the pixels per count the cursor
+  // moved, and every batch ends where the cursor is, which keeps
+  // MinMovementSpeed in pixels per second as in the other modes.
+  void FlushRawMouseBatch() {
+    if (raw_batch_size_ == 0) return;
+
+    POINT cursor = {static_cast<LONG>(std::lround(raw_x_)),
+                    static_cast<LONG>(std::lround(raw_y_))};
+    GetCursorPos(&cursor);
+    UpdateRawInputGain(cursor);
+
+    const long long now = HighResClock::NowMicroseconds();
+    const long long count = static_cast<long long>(raw_batch_size_);
+    const long long span =
+        (std::min)(now - last_raw_input_time_us_,
+                   (count - 1) * CursorConfig::kRawInputReportIntervalUs);
+    size_t sample_count = 0;
+    for (long long i = 0; i < count; ++i) {
+      long long timestamp = (count > 1) ? now - span + span * i / (count - 1)
+                                        : now;
+      if (ToMouseSample(raw_batch_[i], cursor, timestamp,
+                        raw_samples_[sample_count])) {
+        sample_count++;
+      }
+    }
+    ProcessMouseBatch(raw_samples_, sample_count);
+
+    raw_x_ = cursor.x;
+    raw_y_ = cursor.y;
+    last_raw_input_time_us_ = now;
+    raw_batch_size_ = 0;
+  }
+
+  // Short or reversing batches say little about the gain, so they keep the
+  // previous one
+  void UpdateRawInputGain(const POINT& cursor) {
+    double counts_x = 0;
+    double counts_y = 0;
+    for (size_t i = 0; i < raw_batch_size_; ++i) {
+      const RAWMOUSE& mouse = raw_batch_[i].mouse;
+      if (!(mouse.usFlags & MOUSE_MOVE_ABSOLUTE)) {
+        counts_x += mouse.lLastX;
+        counts_y += mouse.lLastY;
+      }
+    }
+    const double counts = std::hypot(counts_x, counts_y);
+    if (counts >= CursorConfig::kRawInputGainMinCounts) {
+      raw_gain_ = std::hypot(cursor.x - raw_x_, cursor.y - raw_y_) / counts;
+    }
+  }
+
+  // Returns false for packets that do not move the cursor
+  bool ToMouseSample(const RawMousePacket& packet, const POINT& cursor,
+                     long long timestamp_us, MouseSample& sample) {
+    const RAWMOUSE& mouse = packet.mouse;
+    if (mouse.usFlags & MOUSE_MOVE_ABSOLUTE) {
+      // Tablets and remote sessions report absolute coordinates, so fall back
+      // to the actual cursor position
+      raw_x_ = cursor.x;
+      raw_y_ = cursor.y;
+    } else {
+      // Skip button and wheel only packets
+      if (mouse.lLastX == 0 && mouse.lLastY == 0) return false;
+      raw_x_ += mouse.lLastX * raw_gain_;
+      raw_y_ += mouse.lLastY * raw_gain_;
+    }
+
+    sample = {{static_cast<LONG>(std::lround(raw_x_)),
+               static_cast<LONG>(std::lround(raw_y_))},
+              timestamp_us, CursorConfig::MouseTrackingMode::kRawInput,
+              packet.device};
+    return true;
+  }
+
   static LRESULT CALLBACK WindowProc(HWND hwnd, UINT msg, WPARAM wParam,
                                      LPARAM lParam) {
     auto* instance = reinterpret_cast<ShakeToFindCursor*>(
         GetWindowLongPtr(hwnd, GWLP_USERDATA));
 
     switch (msg) {
+      case CursorConfig::kStatsChangedMessage:
+        // Coalesces the changes of the next interval into one update
+        if (instance && instance->shared_stats_) {
+          SetTimer(hwnd, CursorConfig::kStatsTimerId,
+                   CursorConfig::kStatsPublishIntervalMs, nullptr);
+        }
+        return 0;
+
       case WM_TIMER:
-        if (wParam == CursorConfig::kTimerId && instance) {
-          if (instance->tracking_mode_ ==
-              CursorConfig::MouseTrackingMode::kPolling) {
-            POINT pt;
-            GetCursorPos(&pt);
-            instance->ProcessMouseMove(reinterpret_cast<MSLLHOOKSTRUCT*>(&pt));
+        if (wParam == CursorConfig::kStatsTimerId && instance &&
+            instance->shared_stats_) {
+          // Stays off until the detection thread reports another change
+          KillTimer(hwnd, CursorConfig::kStatsTimerId);
+          instance->stats_changed_.store(false, std::memory_order_relaxed);
+          instance->PublishStats();
+        }
+        return 0;
+
+      case CursorConfig::kSharedControlMessage:
+        if (instance && instance->shared_stats_) {
+          instance->ApplySharedControl();
+          instance->PublishStats();
+        }
+        return 0;
+
+      case WM_COPYDATA: {
+        const auto* data = reinterpret_cast<const COPYDATASTRUCT*>(lParam);
+        if (!instance || data->dwData != CursorConfig::kCopyDataCommandLine) {
+          break;
+        }
+        std::wstring command_line(static_cast<const wchar_t*>(data->lpData),
+                                  data->cbData / sizeof(wchar_t));
+        // The sender only waits for the copy, not for the restart
+        ReplyMessage(TRUE);
+        instance->ApplyCommandLine(command_line);
+        return TRUE;
+      }
+
+      case WM_SETTINGCHANGE:
+        if (wParam == SPI_SETCURSORS && instance) {
+          instance->cursor_state_.OnCursorSchemeChanged();
+        }
+        return 0;
+
+      case WM_DISPLAYCHANGE:
+      case WM_DPICHANGED:
+        if (instance) {
+          instance->cursor_state_.OnDisplayChanged();
+          // Exclusive fullscreen games switch the display mode
+          if (msg == WM_DISPLAYCHANGE && instance->foreground_hook_) {
+            instance->CheckFullscreen();
           }
-          instance->cursor_state_.RestoreIfNeeded();
+        }
+        break;
+
+      case CursorConfig::kAppBarMessage:
+        if (wParam == ABN_FULLSCREENAPP && instance) {
+          instance->CheckFullscreen();
+        }
+        return 0;
+
+      case WM_HOTKEY:
+        if (wParam == CursorConfig::kLabelHotkeyId && instance) {
+          // Audible so the label can be toggled without looking
+          bool label = !instance->shake_label_.load(std::memory_order_relaxed);
+          instance->shake_label_.store(label, std::memory_order_relaxed);
+          MessageBeep(label ? MB_ICONASTERISK : MB_OK);
+        }
+        return 0;
+
+      case WM_WTSSESSION_CHANGE:
+        if (!instance) break;
+        if (wParam == WTS_SESSION_LOCK || wParam == WTS_SESSION_UNLOCK) {
+          instance->SetSuspended(kSuspendLocked, wParam == WTS_SESSION_LOCK);
+        } else if (wParam == WTS_CONSOLE_DISCONNECT ||
+                   wParam == WTS_REMOTE_DISCONNECT) {
+          instance->SetSuspended(kSuspendDisconnected, true);
+        } else if (wParam == WTS_CONSOLE_CONNECT ||
+                   wParam == WTS_REMOTE_CONNECT) {
+          instance->SetSuspended(kSuspendDisconnected, false);
         }
         return 0;
 
+      case WM_POWERBROADCAST:
+        if (!instance) break;
+        if (wParam == PBT_APMSUSPEND) {
+          instance->SetSuspended(kSuspendSleeping, true);
+        } else if (wParam == PBT_APMRESUMEAUTOMATIC) {
+          instance->SetSuspended(kSuspendSleeping, false);
+        }
+        return TRUE;
+
       case WM_DESTROY:
         PostQuitMessage(0);
         return 0;
@@ -801,21 +1283,32 @@ class ShakeToFindCursor {
         if (LOWORD(wParam) == CursorConfig::kMenuExitId) {
           instance->Stop();
         } else if (LOWORD(wParam) == CursorConfig::kMenuAutoStartId) {
-          if (AutoStartManager::EnableAutoStart()) {
+          instance->auto_start_->Post(AutoStartManager::Command::kEnable);
+        } else if (LOWORD(wParam) == CursorConfig::kMenuStatsId) {
+          LatencyStats::GetInstance().TraceSnapshot();
+          MessageBoxW(hwnd, LatencyStats::GetInstance().Report().c_str(),
+                      L"Stats", MB_OK | MB_ICONINFORMATION);
+        } else if (LOWORD(wParam) == CursorConfig::kMenuDisableAutoStartId) {
+          instance->auto_start_->Post(AutoStartManager::Command::kDisable);
+        }
+        return 0;
+
+      case CursorConfig::kAutoStartResultMessage:
+        if (static_cast<AutoStartManager::Command>(wParam) ==
+            AutoStartManager::Command::kEnable) {
+          if (lParam) {
             MessageBoxW(hwnd, L"Auto-start enabled successfully.", L"Success",
                         MB_OK | MB_ICONINFORMATION);
           } else {
             MessageBoxW(hwnd, L"Failed to enable auto-start.", L"Error",
                         MB_OK | MB_ICONERROR);
           }
-        } else if (LOWORD(wParam) == CursorConfig::kMenuDisableAutoStartId) {
-          if (AutoStartManager::DisableAutoStart()) {
-            MessageBoxW(hwnd, L"Auto-start disabled successfully.", L"Success",
-                        MB_OK | MB_ICONINFORMATION);
-          } else {
-            MessageBoxW(hwnd, L"Failed to disable auto-start.", L"Error",
-                        MB_OK | MB_ICONERROR);
-          }
+        } else if (lParam) {
+          MessageBoxW(hwnd, L"Auto-start disabled successfully.", L"Success",
+                      MB_OK | MB_ICONINFORMATION);
+        } else {
+          MessageBoxW(hwnd, L"Failed to disable auto-start.", L"Error",
+                      MB_OK | MB_ICONERROR);
         }
         return 0;
     }
@@ -848,14 +1341,21 @@ class ShakeToFindCursor {
     HMENU menu = CreatePopupMenu();
     if (!menu) return;
 
-    bool is_auto_start = AutoStartManager::IsAutoStartEnabled();
-    if (is_auto_start) {
-      AppendMenuW(menu, MF_STRING, CursorConfig::kMenuDisableAutoStartId,
-                  L"Disable Auto-start");
-    } else {
-      AppendMenuW(menu, MF_STRING, CursorConfig::kMenuAutoStartId,
-                  L"Enable Auto-start");
+    // The cached state never blocks on the Task Scheduler
+    switch (auto_start_->GetState()) {
+      case AutoStartManager::State::kEnabled:
+        AppendMenuW(menu, MF_STRING, CursorConfig::kMenuDisableAutoStartId,
+                    L"Disable Auto-start");
+        break;
+      case AutoStartManager::State::kDisabled:
+        AppendMenuW(menu, MF_STRING, CursorConfig::kMenuAutoStartId,
+                    L"Enable Auto-start");
+        break;
+      case AutoStartManager::State::kUnknown:
+        AppendMenuW(menu, MF_STRING | MF_GRAYED, 0, L"Checking Auto-start...");
+        break;
     }
+    AppendMenuW(menu, MF_STRING, CursorConfig::kMenuStatsId, L"Stats");
     AppendMenuW(menu, MF_SEPARATOR, 0, nullptr);
     AppendMenuW(menu, MF_STRING, CursorConfig::kMenuExitId, L"Exit");
 
@@ -866,32 +1366,127 @@ class ShakeToFindCursor {
 
   HHOOK mouse_hook_ = nullptr;
   HWND hwnd_ = nullptr;
+  HWND input_hwnd_ = nullptr;  // Owned by the input thread
+  HWINEVENTHOOK foreground_hook_ = nullptr;
+  bool appbar_registered_ = false;  // For ABN_FULLSCREENAPP
+  unsigned suspend_reasons_ = 0;  // SuspendReason bits; UI thread only
+  std::thread input_thread_;
+  DWORD input_thread_id_ = 0;
   CursorState cursor_state_;
-  MouseMoveDetector move_detector_;
+  std::unique_ptr<MouseMoveDetector> move_detector_;
+  PollingScheduler polling_scheduler_;
+  MouseHistoryReader mouse_history_;
+  MouseSample polling_samples_[MouseHistoryReader::kMaxPoints];
   std::atomic<bool> running_{false};
+  SpscQueue<MouseSample, CursorConfig::kSampleQueueSize> sample_queue_;
+  HANDLE sample_event_ = nullptr;
+  std::thread detection_thread_;
+  std::atomic<bool> detection_running_{false};
+  std::atomic<bool> detection_waiting_{false};
+  std::unique_ptr<MouseTraceWriter> recorder_;
+  std::unique_ptr<AutoStartManager> auto_start_;
+  std::unique_ptr<SharedStatsPublisher> shared_stats_;
+  HANDLE control_wait_ = nullptr;  // Thread pool wait on its control event
+  std::atomic<bool> stats_changed_{false};  // kStatsChangedMessage posted
+  std::atomic<bool> shake_label_{false};  // Toggled by the label hotkey
   bool tray_icon_added_ = false;
   CursorConfig::MouseTrackingMode tracking_mode_;
+  bool raw_input_registered_ = false;
+  bool raw_input_wow64_ = false;
+  // Raw input position in pixels, re-anchored to the cursor every batch
+  double raw_x_ = 0;
+  double raw_y_ = 0;
+  double raw_gain_ = 1.0;  // Pixels per relative raw input count
+  RawMousePacket raw_batch_[CursorConfig::kRawInputBatchSize];
+  MouseSample raw_samples_[CursorConfig::kRawInputBatchSize];
+  size_t raw_batch_size_ = 0;
+  long long last_raw_input_time_us_ = 0;
+  // ULONGLONG storage keeps the buffer 8-byte aligned as GetRawInputBuffer
+  // requires
+  ULONGLONG raw_input_buffer_[CursorConfig::kRawInputBufferSize /
+                              sizeof(ULONGLONG)];
 };
 
-bool IsRunAsAdmin() {
-  BOOL is_admin = FALSE;
-  PSID admin_group = nullptr;
-  SID_IDENTIFIER_AUTHORITY nt_authority = SECURITY_NT_AUTHORITY;
-
-  if (AllocateAndInitializeSid(&nt_authority, 2, SECURITY_BUILTIN_DOMAIN_RID,
-                               DOMAIN_ALIAS_RID_ADMINS, 0, 0, 0, 0, 0, 0,
-                               &admin_group)) {
-    if (!CheckTokenMembership(nullptr, admin_group, &is_admin)) {
-      is_admin = FALSE;
+// Value following a command line option, or an empty string
+std::wstring GetOptionValue(const wchar_t* option) {
+  std::wstring value;
+  int argc = 0;
+  LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+  if (!argv) return value;
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (wcscmp(argv[i], option) == 0) {
+      value = argv[i + 1];
+      break;
     }
-    FreeSid(admin_group);
   }
-  return is_admin != FALSE;
+  LocalFree(argv);
+  return value;
+}
+
+// Returns false if another instance in this session got there first. The
+// mutex is held until the process exits, so a restart cannot overlap the
+// previous instance restoring the cursors. An elevated instance's mutex
+// cannot be opened from an unelevated one, which also means it is running.
+bool AcquireSingleInstance() {
+  HANDLE mutex = CreateMutexW(nullptr, FALSE, CursorConfig::kInstanceMutexName);
+  return mutex && GetLastError() != ERROR_ALREADY_EXISTS;
+}
+
+// Hands this process's command line to the running instance. Its window
+// may not exist yet if both were started together.
+bool ForwardCommandLine() {
+  const ULONGLONG deadline =
+      GetTickCount64() + CursorConfig::kInstanceHandoffTimeoutMs;
+  HWND running = FindWindowW(ShakeToFindCursor::kWindowClassName, nullptr);
+  while (!running && GetTickCount64() < deadline) {
+    Sleep(CursorConfig::kInstanceHandoffRetryMs);
+    running = FindWindowW(ShakeToFindCursor::kWindowClassName, nullptr);
+  }
+  if (!running) return false;
+
+  LPCWSTR command_line = GetCommandLineW();
+  COPYDATASTRUCT data = {};
+  data.dwData = CursorConfig::kCopyDataCommandLine;
+  data.cbData = static_cast<DWORD>(wcslen(command_line) * sizeof(wchar_t));
+  data.lpData = const_cast<LPWSTR>(command_line);
+  return SendMessageTimeoutW(running, WM_COPYDATA, 0,
+                             reinterpret_cast<LPARAM>(&data),
+                             SMTO_ABORTIFHUNG,
+                             CursorConfig::kInstanceHandoffTimeoutMs,
+                             nullptr) != 0;
 }
 
 #ifdef CONSOLE_MODE
 int main(int argc, char* argv[]) {
-  if (!IsRunAsAdmin()) {
+  if (argc > 1 && std::string(argv[1]) == "--benchscale") {
+    std::wcout << ScalerBenchmark::Run();
+    return 0;
+  }
+
+  // Created first so that it outlives the other singletons
+  Logger& logger = Logger::GetInstance();
+  // Created before the app, whose threads keep recording into it until its
+  // destructor has joined them
+  LatencyStats::GetInstance();
+
+  // A second launch only hands its options to the running instance
+  if (!AcquireSingleInstance()) {
+    return ForwardCommandLine() ? 0 : 1;
+  }
+
+  CursorConfig::RenderMode render_mode =
+      CursorConfig::RenderMode::kSystemCursor;
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) == "--overlay") {
+      render_mode = CursorConfig::RenderMode::kOverlay;
+    } else if (std::string(argv[i]) == "--debuglog") {
+      logger.SetLevel(LogLevel::kDebug);
+    }
+  }
+
+  // The overlay never touches the system cursor scheme
+  if (render_mode == CursorConfig::RenderMode::kSystemCursor &&
+      !IsRunAsAdmin()) {
     std::cerr << "This program requires administrator privileges to run."
               << std::endl;
     return 1;
@@ -899,17 +1494,22 @@ int main(int argc, char* argv[]) {
 
   ComInitializer com_initializer;
 
-  SetProcessDPIAware();
+  DpiUtils::EnableDpiAwareness();
 
   CursorConfig::MouseTrackingMode mode =
       CursorConfig::MouseTrackingMode::kPolling;
   if (argc > 1 && std::string(argv[1]) == "--hook") {
     mode = CursorConfig::MouseTrackingMode::kHook;
+  } else if (argc > 1 && std::string(argv[1]) == "--rawinput") {
+    mode = CursorConfig::MouseTrackingMode::kRawInput;
   }
 
   try {
     auto& cursor_finder = ShakeToFindCursor::GetInstance();
-    if (!cursor_finder.Initialize(mode)) {
+    if (!cursor_finder.Initialize(
+            mode, render_mode, GetOptionValue(L"--record"),
+            MouseMoveDetector::Load(GetConfigPath(),
+                                    GetOptionValue(L"--preset")))) {
       return 1;
     }
 
@@ -921,7 +1521,7 @@ int main(int argc, char* argv[]) {
     cursor_finder.Run();
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << std::endl;
-    SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE);
+    CursorRecovery::RecoverIfDirty();
     return 1;
   }
   return 0;
@@ -934,7 +1534,33 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
   UNREFERENCED_PARAMETER(lpCmdLine);
   UNREFERENCED_PARAMETER(nCmdShow);
 
-  if (!IsRunAsAdmin()) {
+  if (wcsstr(lpCmdLine, L"--benchscale")) {
+    MessageBoxW(nullptr, ScalerBenchmark::Run().c_str(),
+                L"Cursor Scaling Benchmark", MB_OK | MB_ICONINFORMATION);
+    return 0;
+  }
+
+  // Created first so that it outlives the other singletons
+  Logger& logger = Logger::GetInstance();
+  // Created before the app, whose threads keep recording into it until its
+  // destructor has joined them
+  LatencyStats::GetInstance();
+  if (wcsstr(lpCmdLine, L"--debuglog")) {
+    logger.SetLevel(LogLevel::kDebug);
+  }
+
+  // A second launch only hands its options to the running instance
+  if (!AcquireSingleInstance()) {
+    return ForwardCommandLine() ? 0 : 1;
+  }
+
+  CursorConfig::RenderMode render_mode =
+      wcsstr(lpCmdLine, L"--overlay") ? CursorConfig::RenderMode::kOverlay
+                                      : CursorConfig::RenderMode::kSystemCursor;
+
+  // The overlay never touches the system cursor scheme
+  if (render_mode == CursorConfig::RenderMode::kSystemCursor &&
+      !IsRunAsAdmin()) {
     MessageBoxW(nullptr,
                 L"This program requires administrator privileges to run.",
                 L"Error", MB_OK | MB_ICONERROR);
@@ -943,17 +1569,22 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
 
   ComInitializer com_initializer;
 
-  SetProcessDPIAware();
+  DpiUtils::EnableDpiAwareness();
 
   CursorConfig::MouseTrackingMode mode =
       CursorConfig::MouseTrackingMode::kPolling;
   if (wcsstr(lpCmdLine, L"--hook")) {
     mode = CursorConfig::MouseTrackingMode::kHook;
+  } else if (wcsstr(lpCmdLine, L"--rawinput")) {
+    mode = CursorConfig::MouseTrackingMode::kRawInput;
   }
 
   try {
     auto& cursor_finder = ShakeToFindCursor::GetInstance();
-    if (!cursor_finder.Initialize(mode)) {
+    if (!cursor_finder.Initialize(
+            mode, render_mode, GetOptionValue(L"--record"),
+            MouseMoveDetector::Load(GetConfigPath(),
+                                    GetOptionValue(L"--preset")))) {
       return 1;
     }
 
@@ -966,10 +1597,10 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance,
     std::wstringstream ws;
     ws << L"Error: " << e.what();
     MessageBoxW(nullptr, ws.str().c_str(), L"Error", MB_OK | MB_ICONERROR);
-    DEBUG_LOG("Error: " + std::string(e.what()));
-    SystemParametersInfo(SPI_SETCURSORS, 0, nullptr, SPIF_SENDCHANGE);
+    ERROR_LOG("Error: " + std::string(e.what()));
+    CursorRecovery::RecoverIfDirty();
     return 1;
   }
   return 0;
 }
-#endif
\ No newline at end of file
+#endif
\ No newline at end of file
@@ -0,0 +1,597 @@
+#ifndef MOUSE_DETECTOR_H_
+#define MOUSE_DETECTOR_H_
+
+#include "shake_common.h"
+
+// Fixed-capacity ring buffer stored inline; never allocates
+template <typename T, size_t Capacity>
+class RingBuffer {
+  static_assert(Capacity != 0, "Capacity must not be zero");
+
+ public:
+  bool Empty() const { return size_ == 0; }
+  bool Full() const { return size_ == Capacity; }
+  size_t Size() const { return size_; }
+
+  // Index 0 is the oldest element
+  T& operator[](size_t index) { return items_[Wrap(head_ + index)]; }
+  const T& operator[](size_t index) const {
+    return items_[Wrap(head_ + index)];
+  }
+
+  T& Front() { return items_[head_]; }
+  T& Back() { return items_[Wrap(head_ + size_ - 1)]; }
+
+  // Caller must make room with PopFront() when the buffer is full
+  void PushBack(const T& item) {
+    items_[Wrap(head_ + size_)] = item;
+    ++size_;
+  }
+
+  void PopFront() {
+    head_ = Wrap(head_ + 1);
+    --size_;
+  }
+
+  // Visits every element as at most two contiguous runs, which keeps
+  // order-independent reductions in simple vectorizable loops
+  template <typename Func>
+  void ForEach(Func func) const {
+    const size_t first_end = std::min<size_t>(head_ + size_, Capacity);
+    for (size_t i = head_; i < first_end; ++i) func(items_[i]);
+    const size_t wrapped = head_ + size_ - first_end;
+    for (size_t i = 0; i < wrapped; ++i) func(items_[i]);
+  }
+
+ private:
+  // Indices never exceed 2 * Capacity, so a compare replaces the modulo
+  static size_t Wrap(size_t index) {
+    return index >= Capacity ? index - Capacity : index;
+  }
+
+  std::array<T, Capacity> items_{};
+  size_t head_ = 0;
+  size_t size_ = 0;
+};
+
+// Cursor position reported by any tracking source
+struct MouseSample {
+  POINT pt;
+  long long timestamp_us;  // HighResClock time the input was captured
+  CursorConfig::MouseTrackingMode source;
+  HANDLE device;  // Raw input device; null for the other sources
+};
+
+// Shake detection thresholds. The presets are compile-time constants, so
+// each ShakeDetector instantiation folds them into its loops; all of them
+// provide the same accessors as RuntimeShakeConfig.
+struct DefaultShakePreset {
+  static constexpr size_t kHistoryCapacity = CursorConfig::kHistorySize;
+  static constexpr size_t HistorySize() { return kHistoryCapacity; }
+  static constexpr int MinDirectionChanges() {
+    return CursorConfig::kMinDirectionChanges;
+  }
+  static constexpr double MinMovementSpeed() {
+    return CursorConfig::kMinMovementSpeed;
+  }
+  static constexpr int MaxTimeWindow() { return CursorConfig::kMaxTimeWindow; }
+};
+
+// Fires on shorter, slower shakes
+struct SensitiveShakePreset {
+  static constexpr size_t kHistoryCapacity = 8;
+  static constexpr size_t HistorySize() { return kHistoryCapacity; }
+  static constexpr int MinDirectionChanges() { return 4; }
+  static constexpr double MinMovementSpeed() { return 600.0; }
+  static constexpr int MaxTimeWindow() { return 500; }
+};
+
+// A 1000 Hz mouse reports a movement every millisecond, so the window has
+// to hold far more movements to span the same shake
+struct Gaming1000HzShakePreset {
+  static constexpr size_t kHistoryCapacity = 256;
+  static constexpr size_t HistorySize() { return kHistoryCapacity; }
+  static constexpr int MinDirectionChanges() { return 6; }
+  static constexpr double MinMovementSpeed() { return 1000.0; }
+  static constexpr int MaxTimeWindow() { return 400; }
+};
+
+// Thresholds read from the [Detector] section of the configuration file
+class RuntimeShakeConfig {
+ public:
+  static constexpr size_t kHistoryCapacity = 256;
+
+  RuntimeShakeConfig() = default;
+
+  // history_size is clamped to what the detector can hold
+  RuntimeShakeConfig(size_t history_size, int min_direction_changes,
+                     double min_movement_speed, int max_time_window)
+      : history_size_((std::clamp)(history_size, size_t{2},
+                                   kHistoryCapacity)),
+        min_direction_changes_(min_direction_changes),
+        min_movement_speed_(min_movement_speed),
+        max_time_window_(max_time_window) {}
+
+  // Missing or unparsable keys keep the default preset's values; thresholds
+  // that fail IsValid() are all replaced by the default preset
+  static RuntimeShakeConfig Load(const std::wstring& path) {
+    RuntimeShakeConfig config;
+    if (path.empty()) return config;
+    config.history_size_ = static_cast<size_t>((std::clamp)(
+        static_cast<int>(GetPrivateProfileIntW(
+            L"Detector", L"HistorySize",
+            static_cast<INT>(DefaultShakePreset::HistorySize()),
+            path.c_str())),
+        2, static_cast<int>(kHistoryCapacity)));
+    config.min_direction_changes_ = static_cast<int>(GetPrivateProfileIntW(
+        L"Detector", L"MinDirectionChanges",
+        DefaultShakePreset::MinDirectionChanges(), path.c_str()));
+    config.min_movement_speed_ = static_cast<double>(GetPrivateProfileIntW(
+        L"Detector", L"MinMovementSpeed",
+        static_cast<INT>(DefaultShakePreset::MinMovementSpeed()),
+        path.c_str()));
+    config.max_time_window_ = static_cast<int>(
+        GetPrivateProfileIntW(L"Detector", L"MaxTimeWindow",
+                              DefaultShakePreset::MaxTimeWindow(),
+                              path.c_str()));
+    if (!config.IsValid()) {
+      LOG_MESSAGE(LogLevel::kWarning,
+                  "Invalid [Detector] thresholds; using the default preset");
+      return RuntimeShakeConfig();
+    }
+    return config;
+  }
+
+  // Anything else fires on every sample or makes Intensity() meaningless
+  bool IsValid() const {
+    return std::isfinite(min_movement_speed_) && min_movement_speed_ > 0 &&
+           max_time_window_ > 0 && min_direction_changes_ >= 1 &&
+           history_size_ >= 2 && history_size_ <= kHistoryCapacity;
+  }
+
+  size_t HistorySize() const { return history_size_; }
+  int MinDirectionChanges() const { return min_direction_changes_; }
+  double MinMovementSpeed() const { return min_movement_speed_; }
+  int MaxTimeWindow() const { return max_time_window_; }
+
+ private:
+  size_t history_size_ = DefaultShakePreset::HistorySize();
+  int min_direction_changes_ = DefaultShakePreset::MinDirectionChanges();
+  double min_movement_speed_ = DefaultShakePreset::MinMovementSpeed();
+  int max_time_window_ = DefaultShakePreset::MaxTimeWindow();
+};
+
+// Shake detector chosen once at startup. Callers pay one virtual call per
+// batch; the per-sample loop is specialized in ShakeDetector.
+class MouseMoveDetector {
+ public:
+  enum class Preset { kDefault, kSensitive, kGaming1000Hz, kCustom };
+
+  static constexpr size_t kNoTrigger = SIZE_MAX;
+
+  virtual ~MouseMoveDetector() = default;
+
+  // kCustom uses the thresholds from custom
+  static std::unique_ptr<MouseMoveDetector> Create(
+      Preset preset, const RuntimeShakeConfig& custom);
+
+  // Detector for preset_name, or for the Preset key of the [Detector]
+  // section in config_path when preset_name is empty. Without either the
+  // default preset is used.
+  static std::unique_ptr<MouseMoveDetector> Load(
+      const std::wstring& config_path, std::wstring preset_name) {
+    if (preset_name.empty() && !config_path.empty()) {
+      wchar_t name[32];
+      GetPrivateProfileStringW(L"Detector", L"Preset", L"default", name,
+                               ARRAYSIZE(name), config_path.c_str());
+      preset_name = name;
+    }
+    if (preset_name.empty()) preset_name = L"default";
+    static const struct {
+      LPCWSTR name;
+      Preset preset;
+    } kPresets[] = {{L"default", Preset::kDefault},
+                    {L"sensitive", Preset::kSensitive},
+                    {L"gaming-1000hz", Preset::kGaming1000Hz},
+                    {L"custom", Preset::kCustom}};
+    for (const auto& entry : kPresets) {
+      if (_wcsicmp(preset_name.c_str(), entry.name) == 0) {
+        return Create(entry.preset, RuntimeShakeConfig::Load(config_path));
+      }
+    }
+    throw std::runtime_error("Unknown detector preset");
+  }
+
+  // Speed uses the capture timestamp of the sample, so it reflects the real
+  // interval between samples rather than processing time
+  virtual bool ShouldEnlargeCursor(const MouseSample& sample) = 0;
+
+  // Feeds samples in capture order in one pass. Returns the index of the
+  // first sample that completes a shake, or kNoTrigger; the pattern is not
+  // checked again once a sample in the batch has triggered.
+  virtual size_t ProcessBatch(const MouseSample* samples, size_t count) = 0;
+
+  // Average speed of the last detected shake as a multiple of the
+  // threshold, so at least 1
+  virtual double Intensity() const = 0;
+
+  // The thresholds in use, whichever preset they came from
+  virtual RuntimeShakeConfig Thresholds() const = 0;
+
+  // Forgets the window and starts from a known sample instead of the live
+  // cursor, for replaying recorded input or resuming after a suspension
+  virtual void Reset(const MouseSample& origin) = 0;
+};
+
+// Shake pattern recognition specialized for one set of thresholds
+template <typename Config>
+class ShakeDetector final : public MouseMoveDetector {
+ public:
+  explicit ShakeDetector(const Config& config = Config()) : config_(config) {
+    GetCursorPos(&last_pos_);
+    last_time_us_ = HighResClock::NowMicroseconds();
+  }
+
+  bool ShouldEnlargeCursor(const MouseSample& sample) override {
+    if (!Advance(sample) || !DetectShakePattern()) return false;
+    intensity_ = AverageSpeed() / config_.MinMovementSpeed();
+    return true;
+  }
+
+  size_t ProcessBatch(const MouseSample* samples, size_t count) override {
+    size_t trigger = kNoTrigger;
+    for (size_t i = 0; i < count; ++i) {
+      if (Advance(samples[i]) && trigger == kNoTrigger &&
+          DetectShakePattern()) {
+        trigger = i;
+        intensity_ = AverageSpeed() / config_.MinMovementSpeed();
+      }
+    }
+    return trigger;
+  }
+
+  double Intensity() const override { return intensity_; }
+
+  RuntimeShakeConfig Thresholds() const override {
+    return RuntimeShakeConfig(config_.HistorySize(),
+                              config_.MinDirectionChanges(),
+                              config_.MinMovementSpeed(),
+                              config_.MaxTimeWindow());
+  }
+
+  void Reset(const MouseSample& origin) override {
+    while (!movement_history_.Empty()) movement_history_.PopFront();
+    last_pos_ = origin.pt;
+    last_time_us_ = origin.timestamp_us;
+    total_direction_changes_ = 0;
+    total_speed_ = 0.0;
+    total_time_ = 0;
+    movements_since_resync_ = 0;
+    intensity_ = 1.0;
+  }
+
+ private:
+  // Returns true if the sample added a movement to the window
+  bool Advance(const MouseSample& sample) {
+    const POINT& current_pos = sample.pt;
+    long long delta_time = sample.timestamp_us - last_time_us_;
+
+    // A sample without a later timestamp is folded into the next one, which
+    // then carries its movement
+    if (delta_time <= 0) return false;
+
+    // Calculate movement vector
+    int dx = current_pos.x - last_pos_.x;
+    int dy = current_pos.y - last_pos_.y;
+
+    // Update position history
+    AddMovement(dx, dy, delta_time);
+
+    last_pos_ = current_pos;
+    last_time_us_ = sample.timestamp_us;
+    return true;
+  }
+
+  // Packed into 24 bytes without padding
+  struct Movement {
+    int dx;
+    int dy;
+    int dt;                 // Microseconds
+    int direction_changes;  // Direction changes relative to previous movement
+    double speed;           // Pixels per second
+  };
+
+  static int Direction(int delta) {
+    return (delta > 0) ? 1 : (delta < 0) ? -1 : 0;
+  }
+
+  // Direction changes between two consecutive movements; a neutral axis on
+  // either side never counts as a change
+  static int CountDirectionChanges(const Movement& prev, const Movement& curr) {
+    int prev_x_dir = Direction(prev.dx);
+    int prev_y_dir = Direction(prev.dy);
+    int curr_x_dir = Direction(curr.dx);
+    int curr_y_dir = Direction(curr.dy);
+
+    int changes = 0;
+    if (prev_x_dir != 0 && curr_x_dir != 0 && prev_x_dir != curr_x_dir) {
+      changes++;
+    }
+    if (prev_y_dir != 0 && curr_y_dir != 0 && prev_y_dir != curr_y_dir) {
+      changes++;
+    }
+    return changes;
+  }
+
+  // Slides the window by one movement, keeping the running totals in sync
+  void AddMovement(int dx, int dy, long long delta_time) {
+    // Anything this long already exceeds the time window on its own
+    int dt = static_cast<int>(std::min<long long>(delta_time, INT_MAX));
+    Movement mov = {dx, dy, dt, 0, 0.0};
+
+    // Axis-aligned moves are the common case and need no square root
+    int squared_distance = dx * dx + dy * dy;
+    double distance = (dx == 0 || dy == 0)
+                          ? static_cast<double>(std::abs(dx + dy))
+                          : std::sqrt(squared_distance);
+    mov.speed = (dt > 0) ? (distance / dt) * 1000000.0 : 0;
+
+    if (!movement_history_.Empty()) {
+      mov.direction_changes =
+          CountDirectionChanges(movement_history_.Back(), mov);
+    }
+
+    if (movement_history_.Size() >= config_.HistorySize()) {
+      const Movement& oldest = movement_history_.Front();
+      total_speed_ -= oldest.speed;
+      total_time_ -= oldest.dt;
+      movement_history_.PopFront();
+
+      // The new oldest movement has no predecessor inside the window
+      if (!movement_history_.Empty()) {
+        Movement& front = movement_history_.Front();
+        total_direction_changes_ -= front.direction_changes;
+        front.direction_changes = 0;
+      }
+    }
+
+    movement_history_.PushBack(mov);
+    total_direction_changes_ += mov.direction_changes;
+    total_speed_ += mov.speed;
+    total_time_ += mov.dt;
+
+    // Re-sum the speeds once per full window turnover so floating point
+    // error from the add/subtract updates cannot accumulate
+    if (++movements_since_resync_ >= config_.HistorySize()) {
+      movements_since_resync_ = 0;
+      double total_speed = 0.0;
+      movement_history_.ForEach([&total_speed](const Movement& entry) {
+        total_speed += entry.speed;
+      });
+      total_speed_ = total_speed;
+    }
+  }
+
+  bool DetectShakePattern() const {
+    if (movement_history_.Size() < config_.HistorySize()) return false;
+
+    // Check if we're within the time window
+    if (total_time_ > config_.MaxTimeWindow() * 1000LL) return false;
+
+    // Return true if we have enough direction changes and sufficient speed
+    return total_direction_changes_ >= config_.MinDirectionChanges() &&
+           AverageSpeed() >= config_.MinMovementSpeed();
+  }
+
+  double AverageSpeed() const { return total_speed_ / config_.HistorySize(); }
+
+  const Config config_;
+  POINT last_pos_;
+  long long last_time_us_;
+  RingBuffer<Movement, Config::kHistoryCapacity> movement_history_;
+  int total_direction_changes_ = 0;
+  double total_speed_ = 0.0;
+  long long total_time_ = 0;
+  size_t movements_since_resync_ = 0;
+  double intensity_ = 1.0;
+};
+
+inline std::unique_ptr<MouseMoveDetector> MouseMoveDetector::Create(
+    Preset preset, const RuntimeShakeConfig& custom) {
+  switch (preset) {
+    case Preset::kSensitive:
+      return std::make_unique<ShakeDetector<SensitiveShakePreset>>();
+    case Preset::kGaming1000Hz:
+      return std::make_unique<ShakeDetector<Gaming1000HzShakePreset>>();
+    case Preset::kCustom:
+      return std::make_unique<ShakeDetector<RuntimeShakeConfig>>(custom);
+    case Preset::kDefault:
+      break;
+  }
+  return std::make_unique<ShakeDetector<DefaultShakePreset>>();
+}
+
+// Lock-free single-producer/single-consumer ring buffer
+template <typename T, size_t Capacity>
+class SpscQueue {
+  static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+ public:
+  // Producer side; returns false and drops the item when the queue is full
+  bool Push(const T& item) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head - cached_tail_ == Capacity) {
+      cached_tail_ = tail_.load(std::memory_order_acquire);
+      if (head - cached_tail_ == Capacity) return false;
+    }
+    items_[head & (Capacity - 1)] = item;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; returns false when the queue is empty
+  bool Pop(T& item) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == cached_head_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+      if (tail == cached_head_) return false;
+    }
+    item = items_[tail & (Capacity - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side; pops up to max_count items with a single index update
+  // and returns how many were taken
+  size_t PopBatch(T* items, size_t max_count) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail == cached_head_) {
+      cached_head_ = head_.load(std::memory_order_acquire);
+    }
+    const size_t count = (std::min)(cached_head_ - tail, max_count);
+    for (size_t i = 0; i < count; ++i) {
+      items[i] = items_[(tail + i) & (Capacity - 1)];
+    }
+    if (count) {
+      tail_.store(tail + count, std::memory_order_release);
+    }
+    return count;
+  }
+
+  bool Empty() const {
+    return tail_.load(std::memory_order_acquire) ==
+           head_.load(std::memory_order_acquire);
+  }
+
+ private:
+  // Producer and consumer indices live on separate cache lines
+  std::atomic<size_t> head_{0};
+  size_t cached_tail_ = 0;
+  char head_padding_[CursorConfig::kCacheLineSize - sizeof(size_t) * 2];
+  std::atomic<size_t> tail_{0};
+  size_t cached_head_ = 0;
+  char tail_padding_[CursorConfig::kCacheLineSize - sizeof(size_t) * 2];
+  T items_[Capacity];
+};
+
+// Picks the polling mode timer period: fast while the cursor moves, slow
+// once it has been still for kPollingIdleTimeoutMs. Used on the input
+// thread.
+class PollingScheduler {
+ public:
+  struct Stats {
+    UINT period_ms;
+    unsigned long long wakeups;
+    unsigned long long fast_wakeups;
+    unsigned long long period_changes;
+  };
+
+  PollingScheduler() { GetCursorPos(&last_pos_); }
+
+  UINT Period() const { return period_ms_; }
+
+  // Records one timer wakeup; returns true when the period should change
+  bool OnSample(const POINT& pt, long long timestamp_us) {
+    wakeups_++;
+    if (period_ms_ == CursorConfig::kPollingInterval) {
+      fast_wakeups_++;
+    }
+    if (pt.x != last_pos_.x || pt.y != last_pos_.y) {
+      last_pos_ = pt;
+      last_move_time_us_ = timestamp_us;
+    }
+
+    bool quiet = timestamp_us - last_move_time_us_ >=
+                 CursorConfig::kPollingIdleTimeoutMs * 1000LL;
+    UINT period = quiet ? CursorConfig::kIdlePollingInterval
+                        : CursorConfig::kPollingInterval;
+    if (period == period_ms_) return false;
+    period_ms_ = period;
+    period_changes_++;
+    return true;
+  }
+
+  Stats GetStats() const {
+    return {period_ms_, wakeups_, fast_wakeups_, period_changes_};
+  }
+
+ private:
+  POINT last_pos_;
+  long long last_move_time_us_ = LLONG_MIN / 2;  // Starts out quiet
+  UINT period_ms_ = CursorConfig::kIdlePollingInterval;
+  unsigned long long wakeups_ = 0;
+  unsigned long long fast_wakeups_ = 0;
+  unsigned long long period_changes_ = 0;
+};
+
+// Recovers the points the cursor passed through between two polls from the
+// mouse history the system keeps for GetMouseMovePointsEx
+class MouseHistoryReader {
+ public:
+  static constexpr int kMaxPoints = 64;  // Size of the system history
+
+  // Writes the points recorded since the previous call to samples, oldest
+  // first, and returns how many; -1 if current is not in the history
+  int Read(const POINT& current, long long now_us, MouseSample* samples) {
+    MOUSEMOVEPOINT query = {};
+    query.x = current.x & 0xFFFF;
+    query.y = current.y & 0xFFFF;
+    MOUSEMOVEPOINT points[kMaxPoints];
+    int count = GetMouseMovePointsEx(sizeof(MOUSEMOVEPOINT), &query, points,
+                                     kMaxPoints, GMMP_USE_DISPLAY_POINTS);
+    // Fails when the cursor was last moved by SetCursorPos or a remote
+    // session rather than by the mouse
+    if (count <= 0) return -1;
+
+    // The history is newest first; everything up to the last point handed
+    // out is new. Only the current point is new on the first call.
+    int fresh = has_last_ ? 0 : 1;
+    while (has_last_ && fresh < count && IsNewer(points[fresh])) {
+      fresh++;
+    }
+
+    // Point times are tick counts in milliseconds; the difference is taken
+    // in DWORD so it survives the 49.7 day wrap
+    const DWORD now_ticks = GetTickCount();
+    int written = 0;
+    for (int i = fresh - 1; i >= 0; --i) {
+      POINT pt = {Unwrap(points[i].x), Unwrap(points[i].y)};
+      if (pt.x == last_pos_.x && pt.y == last_pos_.y) continue;
+      last_pos_ = pt;
+      long long age_us = static_cast<long long>(now_ticks - points[i].time) *
+                         1000;
+      samples[written++] = {pt, now_us - age_us,
+                            CursorConfig::MouseTrackingMode::kPolling,
+                            nullptr};
+    }
+
+    last_point_ = points[0];
+    has_last_ = true;
+    return written;
+  }
+
+  // Makes the next Read start from the current point again
+  void Reset() { has_last_ = false; }
+
+ private:
+  // Display points are 16 bits wide; monitors left of or above the primary
+  // one come back as large positive values
+  static int Unwrap(int coordinate) {
+    return coordinate > 32767 ? coordinate - 65536 : coordinate;
+  }
+
+  bool IsNewer(const MOUSEMOVEPOINT& point) const {
+    if (point.x == last_point_.x && point.y == last_point_.y &&
+        point.time == last_point_.time) {
+      return false;
+    }
+    return static_cast<LONG>(point.time - last_point_.time) >= 0;
+  }
+
+  MOUSEMOVEPOINT last_point_ = {};
+  POINT last_pos_ = {LONG_MIN, LONG_MIN};
+  bool has_last_ = false;
+};
+
+#endif  // MOUSE_DETECTOR_H_
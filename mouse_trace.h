@@ -0,0 +1,213 @@
+#ifndef MOUSE_TRACE_H_
+#define MOUSE_TRACE_H_
+
+#include "shake_common.h"
+#include "mouse_detector.h"
+
+// Recorded mouse traces are a MouseTraceHeader followed by one fixed-size
+// MouseTraceRecord per sample, in capture order and native byte order
+
+struct MouseTraceHeader {
+  static constexpr uint32_t kMagic = 0x43465453;  // "STFC"
+  static constexpr uint16_t kVersion = 1;
+
+  uint32_t magic;
+  uint16_t version;
+  uint16_t record_size;  // sizeof(MouseTraceRecord) of the writer
+};
+static_assert(sizeof(MouseTraceHeader) == 8, "Trace header layout changed");
+
+struct MouseTraceRecord {
+  static constexpr uint8_t kShakeLabel = 0x01;  // Marked as an intended shake
+
+  int64_t timestamp_us;  // HighResClock capture time
+  int32_t x;
+  int32_t y;
+  uint8_t source;  // CursorConfig::MouseTrackingMode
+  uint8_t flags;
+  uint8_t reserved[6];
+};
+static_assert(sizeof(MouseTraceRecord) == 24, "Trace record layout changed");
+
+// Read-only memory mapping of a trace file; records are used in place
+class MouseTraceReader {
+ public:
+  explicit MouseTraceReader(const std::wstring& path) {
+    file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("Failed to open trace file");
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size) ||
+        size.QuadPart < static_cast<LONGLONG>(sizeof(MouseTraceHeader))) {
+      Close();
+      throw std::runtime_error("Trace file is too short");
+    }
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    view_ = mapping_ ? static_cast<const BYTE*>(
+                           MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0))
+                     : nullptr;
+    if (!view_) {
+      Close();
+      throw std::runtime_error("Failed to map trace file");
+    }
+
+    const auto* header = reinterpret_cast<const MouseTraceHeader*>(view_);
+    if (header->magic != MouseTraceHeader::kMagic ||
+        header->version != MouseTraceHeader::kVersion ||
+        header->record_size != sizeof(MouseTraceRecord)) {
+      Close();
+      throw std::runtime_error("Unsupported trace file format");
+    }
+    count_ = static_cast<size_t>(size.QuadPart - sizeof(MouseTraceHeader)) /
+             sizeof(MouseTraceRecord);
+    // A recording that was not closed cleanly ends in unused, zeroed
+    // records of the last growth step
+    while (count_ && begin()[count_ - 1].timestamp_us == 0) --count_;
+  }
+
+  ~MouseTraceReader() { Close(); }
+
+  MouseTraceReader(const MouseTraceReader&) = delete;
+  MouseTraceReader& operator=(const MouseTraceReader&) = delete;
+
+  size_t size() const { return count_; }
+  const MouseTraceRecord* begin() const {
+    return reinterpret_cast<const MouseTraceRecord*>(
+        view_ + sizeof(MouseTraceHeader));
+  }
+  const MouseTraceRecord* end() const { return begin() + count_; }
+
+  static MouseSample ToSample(const MouseTraceRecord& record) {
+    return {{record.x, record.y},
+            record.timestamp_us,
+            static_cast<CursorConfig::MouseTrackingMode>(record.source),
+            nullptr};
+  }
+
+ private:
+  void Close() {
+    if (view_) {
+      UnmapViewOfFile(view_);
+      view_ = nullptr;
+    }
+    if (mapping_) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+    }
+    if (file_ != INVALID_HANDLE_VALUE) {
+      CloseHandle(file_);
+      file_ = INVALID_HANDLE_VALUE;
+    }
+  }
+
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  const BYTE* view_ = nullptr;
+  size_t count_ = 0;
+};
+
+// Appends samples to a trace through a writable mapping of the file, so
+// recording costs a copy per sample and a remap per growth step instead of
+// a write call per sample. Used by one thread at a time.
+class MouseTraceWriter {
+ public:
+  explicit MouseTraceWriter(const std::wstring& path) {
+    file_ = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+                        FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+      throw std::runtime_error("Failed to create trace file");
+    }
+    if (!Map(CursorConfig::kTraceInitialRecords)) {
+      CloseHandle(file_);
+      throw std::runtime_error("Failed to map trace file");
+    }
+    auto* header = reinterpret_cast<MouseTraceHeader*>(view_);
+    header->magic = MouseTraceHeader::kMagic;
+    header->version = MouseTraceHeader::kVersion;
+    header->record_size = sizeof(MouseTraceRecord);
+  }
+
+  // Cuts the file back to the records actually written
+  ~MouseTraceWriter() {
+    Unmap();
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(sizeof(MouseTraceHeader) +
+                                         count_ * sizeof(MouseTraceRecord));
+    if (SetFilePointerEx(file_, end, nullptr, FILE_BEGIN)) {
+      SetEndOfFile(file_);
+    }
+    CloseHandle(file_);
+  }
+
+  MouseTraceWriter(const MouseTraceWriter&) = delete;
+  MouseTraceWriter& operator=(const MouseTraceWriter&) = delete;
+
+  // Recording stops for good if the file cannot grow
+  void Write(const MouseSample* samples, size_t count, uint8_t flags) {
+    if (failed_) return;
+    if (count_ + count > capacity_ &&
+        !Map((std::max)(capacity_ * 2, count_ + count))) {
+      return;
+    }
+    MouseTraceRecord* records = reinterpret_cast<MouseTraceRecord*>(
+                                    view_ + sizeof(MouseTraceHeader)) +
+                                count_;
+    for (size_t i = 0; i < count; ++i) {
+      records[i] = {samples[i].timestamp_us,
+                    samples[i].pt.x,
+                    samples[i].pt.y,
+                    static_cast<uint8_t>(samples[i].source),
+                    flags,
+                    {}};
+    }
+    count_ += count;
+  }
+
+  size_t Size() const { return count_; }
+
+ private:
+  // Extends the file to the given number of records and maps all of it
+  bool Map(size_t capacity) {
+    Unmap();
+    const unsigned long long bytes =
+        sizeof(MouseTraceHeader) + capacity * sizeof(MouseTraceRecord);
+    mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READWRITE,
+                                  static_cast<DWORD>(bytes >> 32),
+                                  static_cast<DWORD>(bytes), nullptr);
+    view_ = mapping_ ? static_cast<BYTE*>(
+                           MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0))
+                     : nullptr;
+    if (!view_) {
+      ERROR_LOG("Failed to grow the trace file; recording stopped");
+      Unmap();
+      capacity_ = 0;
+      failed_ = true;
+      return false;
+    }
+    capacity_ = capacity;
+    return true;
+  }
+
+  void Unmap() {
+    if (view_) {
+      UnmapViewOfFile(view_);
+      view_ = nullptr;
+    }
+    if (mapping_) {
+      CloseHandle(mapping_);
+      mapping_ = nullptr;
+    }
+  }
+
+  HANDLE file_ = INVALID_HANDLE_VALUE;
+  HANDLE mapping_ = nullptr;
+  BYTE* view_ = nullptr;
+  size_t capacity_ = 0;  // Records the mapping has room for
+  size_t count_ = 0;
+  bool failed_ = false;
+};
+
+#endif  // MOUSE_TRACE_H_
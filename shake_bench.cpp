@@ -0,0 +1,197 @@
+// Replays recorded mouse traces through MouseMoveDetector at full speed and
+// reports throughput, allocations and detection accuracy against the shake
+// labels in the trace.
+//
+// Usage: shake_bench [--repeat N] [--preset NAME] [--config FILE]
+//                    <trace file>...
+
+// clang-format off
+#include "shake_common.h"
+#include "mouse_detector.h"
+#include "mouse_trace.h"
+#include <cstdlib>
+#include <cwchar>
+#include <new>
+// clang-format on
+
+namespace {
+
+std::atomic<unsigned long long> g_allocations{0};
+
+}  // namespace
+
+// Counts every allocation so the replay loop can be checked to make none
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* ptr = std::malloc(size ? size : 1)) return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+
+constexpr int kDefaultRepeat = 10;
+
+// Feeds the trace through a reset detector in the batches the hook's
+// detection thread uses and calls on_trigger with the index of every
+// sample that completes a shake
+template <typename Func>
+void Replay(const MouseTraceReader& trace, MouseMoveDetector& detector,
+            Func on_trigger) {
+  if (trace.size() == 0) return;
+  detector.Reset(MouseTraceReader::ToSample(*trace.begin()));
+  MouseSample batch[CursorConfig::kDetectionBatchSize];
+  const MouseTraceRecord* records = trace.begin();
+  for (size_t start = 0; start < trace.size();
+       start += CursorConfig::kDetectionBatchSize) {
+    const size_t count =
+        (std::min)(CursorConfig::kDetectionBatchSize, trace.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+      batch[i] = MouseTraceReader::ToSample(records[start + i]);
+    }
+    const size_t trigger = detector.ProcessBatch(batch, count);
+    if (trigger != MouseMoveDetector::kNoTrigger) {
+      on_trigger(start + trigger);
+    }
+  }
+}
+
+struct Accuracy {
+  size_t labelled_shakes = 0;  // Runs of labelled samples
+  size_t detected_shakes = 0;  // Labelled runs with at least one trigger
+  size_t false_positives = 0;  // Triggers outside labelled runs
+};
+
+// A trigger outside a labelled shake counts once per enlargement, as the
+// application ignores further triggers while the cursor is enlarged
+Accuracy MeasureAccuracy(const MouseTraceReader& trace,
+                         MouseMoveDetector& detector) {
+  std::vector<size_t> triggers;
+  Replay(trace, detector,
+         [&triggers](size_t index) { triggers.push_back(index); });
+
+  Accuracy accuracy;
+  const MouseTraceRecord* records = trace.begin();
+  size_t next_trigger = 0;
+  bool in_shake = false;
+  bool detected = false;
+  long long last_false_positive_us = LLONG_MIN / 2;
+  for (size_t i = 0; i < trace.size(); ++i) {
+    const bool labelled =
+        (records[i].flags & MouseTraceRecord::kShakeLabel) != 0;
+    if (labelled && !in_shake) {
+      ++accuracy.labelled_shakes;
+      detected = false;
+    }
+    in_shake = labelled;
+
+    if (next_trigger == triggers.size() || triggers[next_trigger] != i) {
+      continue;
+    }
+    ++next_trigger;
+    if (labelled) {
+      if (!detected) ++accuracy.detected_shakes;
+      detected = true;
+    } else if (records[i].timestamp_us - last_false_positive_us >=
+               CursorConfig::kEnlargeDurationMs * 1000LL) {
+      ++accuracy.false_positives;
+      last_false_positive_us = records[i].timestamp_us;
+    }
+  }
+  return accuracy;
+}
+
+void Benchmark(const std::wstring& path, MouseMoveDetector& detector,
+               int repeat) {
+  MouseTraceReader trace(path);
+  std::wcout << path << L": " << trace.size() << L" samples";
+  if (trace.size() == 0) {
+    std::wcout << L"\n";
+    return;
+  }
+  const double duration_s =
+      (trace.end()[-1].timestamp_us - trace.begin()->timestamp_us) / 1e6;
+  std::wcout << L", " << duration_s << L" s\n";
+
+  // The first pass warms the caches and the mapped pages
+  size_t triggers = 0;
+  Replay(trace, detector, [&triggers](size_t) { ++triggers; });
+
+  const unsigned long long allocations_before = g_allocations.load();
+  const long long start = HighResClock::NowTicks();
+  for (int i = 0; i < repeat; ++i) {
+    Replay(trace, detector, [&triggers](size_t) { ++triggers; });
+  }
+  const long long elapsed_ns =
+      HighResClock::TicksToNanoseconds(HighResClock::NowTicks() - start);
+  const unsigned long long allocations =
+      g_allocations.load() - allocations_before;
+
+  const double samples = static_cast<double>(trace.size()) * repeat;
+  std::wcout << L"  Speed: " << samples * 1e3 / elapsed_ns
+             << L"M samples/s, " << elapsed_ns / samples << L" ns/sample, "
+             << allocations << L" allocations\n";
+
+  const Accuracy accuracy = MeasureAccuracy(trace, detector);
+  if (accuracy.labelled_shakes) {
+    std::wcout << L"  Shakes: " << accuracy.detected_shakes << L"/"
+               << accuracy.labelled_shakes << L" detected ("
+               << 100.0 * accuracy.detected_shakes / accuracy.labelled_shakes
+               << L"% true positive rate)\n";
+  } else {
+    std::wcout << L"  Shakes: none labelled\n";
+  }
+  std::wcout << L"  Triggers: " << triggers / (repeat + 1) << L" per pass\n";
+  std::wcout << L"  False positives: " << accuracy.false_positives << L" ("
+             << (duration_s > 0 ? accuracy.false_positives * 60.0 / duration_s
+                                : 0.0)
+             << L" per minute)\n";
+}
+
+}  // namespace
+
+int wmain(int argc, wchar_t* argv[]) {
+  int repeat = kDefaultRepeat;
+  std::wstring preset;
+  std::wstring config_path;
+  std::vector<std::wstring> paths;
+  for (int i = 1; i < argc; ++i) {
+    if (wcscmp(argv[i], L"--repeat") == 0 && i + 1 < argc) {
+      repeat = (std::max)(
+          1, static_cast<int>(std::wcstol(argv[++i], nullptr, 10)));
+    } else if (wcscmp(argv[i], L"--preset") == 0 && i + 1 < argc) {
+      preset = argv[++i];
+    } else if (wcscmp(argv[i], L"--config") == 0 && i + 1 < argc) {
+      config_path = argv[++i];
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    std::wcerr << L"Usage: shake_bench [--repeat N] [--preset NAME] "
+                  L"[--config FILE] <trace file>...\n";
+    return 1;
+  }
+
+  std::unique_ptr<MouseMoveDetector> detector;
+  try {
+    detector = MouseMoveDetector::Load(config_path, preset);
+  } catch (const std::exception& e) {
+    std::wcerr << e.what() << L"\n";
+    return 1;
+  }
+
+  std::wcout << std::fixed << std::setprecision(1);
+  int result = 0;
+  for (const std::wstring& path : paths) {
+    try {
+      Benchmark(path, *detector, repeat);
+    } catch (const std::exception& e) {
+      std::wcerr << path << L": " << e.what() << L"\n";
+      result = 1;
+    }
+  }
+  return result;
+}
@@ -0,0 +1,585 @@
+#ifndef SHAKE_COMMON_H_
+#define SHAKE_COMMON_H_
+
+// Configuration, logging and timing shared by everything built on the
+// shake_core library
+
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0601
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef OEMRESOURCE
+#define OEMRESOURCE
+#endif
+
+// clang-format off
+#include <windows.h>
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <vector>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <TraceLoggingProvider.h>
+
+// Defined in shake_core.cpp
+TRACELOGGING_DECLARE_PROVIDER(g_trace_provider);
+
+// Configuration class to manage all configurable parameters
+class CursorConfig {
+ public:
+  static constexpr double kScaleFactor = 3.0;           // Cursor enlargement factor
+  static constexpr size_t kHistorySize = 10;            // Keep last 10 movements
+  static constexpr int kMinDirectionChanges = 5;        // Minimum direction changes required
+  static constexpr double kMinMovementSpeed = 800.0;    // Minimum speed in pixels/second
+  static constexpr int kMaxTimeWindow = 500;            // Time window in milliseconds
+  static constexpr int kEnlargeDurationMs = 500;        // Cursor enlargement duration (milliseconds)
+  static constexpr int kZoomLevels = 4;                 // Animation frames between normal and full size
+  static constexpr int kMaxZoomLevel = 8;               // Largest level a continued or faster shake reaches (5x)
+  static constexpr int kGrowIntervalMs = 200;           // Continued shaking adds a level this often (milliseconds)
+  static constexpr double kIntensityPerLevel = 0.5;     // Extra speed, in multiples of kMinMovementSpeed, per level above kZoomLevels
+  static constexpr long long kFallbackFramePeriodUs = 16667;  // Frame period when DWM timing is unavailable (microseconds)
+  static constexpr bool kLazyScaling = true;            // Scale cursors on a background thread at startup
+  static constexpr bool kSelectiveEnlarge = true;       // Swap only the shapes seen on screen while enlarged
+  static constexpr size_t kCursorCacheCapacity = 208;   // Scaled cursors kept (13 shapes x 8 levels x 2 DPIs)
+  static constexpr UINT_PTR kTimerId = 1;               // Timer ID
+  static constexpr UINT kPollingInterval = 10;          // Polling interval while the cursor moves (milliseconds)
+  static constexpr UINT kIdlePollingInterval = 100;     // Polling interval while the cursor is still (milliseconds)
+  static constexpr int kPollingIdleTimeoutMs = 1000;    // Stillness before polling slows down (milliseconds)
+  static constexpr bool kInputThreadMmcss = true;       // Register the input thread with MMCSS as a "Games" task
+  static constexpr bool kSuspendInFullscreen = true;    // Switch input off while a fullscreen app is in front
+  static constexpr UINT kTrayIconId = 1;                // Tray icon ID
+  static constexpr UINT kTrayIconMessage = WM_APP + 1;  // Tray message ID
+  static constexpr UINT kAutoStartResultMessage = WM_APP + 2;  // Auto-start change finished
+  static constexpr UINT kStatsChangedMessage = WM_APP + 3;     // Counters changed since the last shared stats update
+  static constexpr UINT kSharedControlMessage = WM_APP + 4;    // Agent signaled new shared thresholds
+  static constexpr UINT kAppBarMessage = WM_APP + 5;           // Fullscreen app opened or closed
+  static constexpr UINT kMenuExitId = 2000;             // Exit menu item ID
+  static constexpr UINT kMenuAutoStartId = 2001;        // Enable auto-start menu item ID
+  static constexpr UINT kMenuDisableAutoStartId = 2002; // Disable auto-start menu item ID
+  static constexpr UINT kMenuStatsId = 2003;            // Stats menu item ID
+  static constexpr bool kPublishSharedStats = true;     // Publish stats and accept thresholds through shared memory
+  static constexpr LPCWSTR kSharedStatsName = L"Local\\ShakeToFindCursorStats";  // Shared stats section name
+  static constexpr LPCWSTR kSharedControlEventName = L"Local\\ShakeToFindCursorControl";  // Set by the agent after a threshold change
+  static constexpr UINT_PTR kStatsTimerId = 2;          // Shared stats timer ID, armed only after a counter change
+  static constexpr UINT kStatsPublishIntervalMs = 1000; // Longest delay before a counter change is published (milliseconds)
+  static constexpr LPCWSTR kInstanceMutexName = L"Local\\ShakeToFindCursorInstance";  // Single-instance mutex name
+  static constexpr ULONG_PTR kCopyDataCommandLine = 0x53544643;  // WM_COPYDATA id of a forwarded command line ("STFC")
+  static constexpr UINT kInstanceHandoffTimeoutMs = 2000;  // Longest wait for the running instance (milliseconds)
+  static constexpr DWORD kInstanceHandoffRetryMs = 50;  // Retry period while its window is not up yet (milliseconds)
+  static constexpr UINT kRawInputBufferSize = 4096;     // GetRawInputBuffer buffer size (bytes)
+  static constexpr size_t kSampleQueueSize = 1024;      // Hook sample queue capacity (power of two)
+  static constexpr size_t kCacheLineSize = 64;          // Cache line size used for padding
+  static constexpr size_t kRawInputBatchSize = 128;     // Raw input packets timestamped together
+  static constexpr size_t kDetectionBatchSize = 64;     // Hook samples detected in one pass
+  static constexpr long long kRawInputReportIntervalUs = 1000;  // Shortest raw input report interval (microseconds)
+  static constexpr double kRawInputGainMinCounts = 8.0;  // Relative motion a raw input batch needs to re-measure pixels per count (mickeys)
+  static constexpr size_t kLogQueueSize = 256;          // Pending log messages (power of two)
+  static constexpr size_t kLogMessageSize = 240;        // Longest log message kept (bytes)
+  static constexpr size_t kLogFlushRecords = 64;        // Pending messages that wake the log writer
+  static constexpr DWORD kLogFlushIntervalMs = 1000;    // Longest delay before messages are written (milliseconds)
+  static constexpr size_t kTraceInitialRecords = 65536; // Records mapped when a recording starts; doubles as it fills
+  static constexpr int kLabelHotkeyId = 1;              // Shake label hotkey ID
+  static constexpr UINT kLabelHotkeyModifiers = MOD_CONTROL | MOD_ALT | MOD_NOREPEAT;  // Shake label hotkey modifiers
+  static constexpr UINT kLabelHotkeyKey = 'L';          // Shake label hotkey key (Ctrl+Alt+L toggles the label)
+
+  enum class ScaleFilter {
+    kBilinear,  // 2-tap tent filter
+    kLanczos3   // 6-tap windowed sinc filter
+  };
+  static constexpr ScaleFilter kScaleFilter = ScaleFilter::kLanczos3;  // Cursor scaling filter
+
+  enum class MouseTrackingMode {
+    kHook,     // Use SetWindowsHookEx
+    kPolling,  // Use GetCursorPos in WM_TIMER
+    kRawInput  // Use WM_INPUT with GetRawInputBuffer
+  };
+
+  enum class RenderMode {
+    kSystemCursor,  // Replace the system cursors with SetSystemCursor
+    kOverlay        // Draw into a layered window over the hidden cursor
+  };
+
+  // Scale factor of zoom level 1..kMaxZoomLevel, evenly spaced so that
+  // kZoomLevels is kScaleFactor
+  static constexpr double ZoomLevelScale(int level) {
+    return 1.0 + (kScaleFactor - 1.0) * level / kZoomLevels;
+  }
+
+  // Level a shake first grows to, given its average speed as a multiple of
+  // the detector threshold
+  static constexpr int ZoomLevelForIntensity(double intensity) {
+    const int extra = static_cast<int>((intensity - 1.0) / kIntensityPerLevel);
+    return kZoomLevels + (std::clamp)(extra, 0, kMaxZoomLevel - kZoomLevels);
+  }
+};
+
+// clang-format on
+
+enum class LogLevel { kDebug, kInfo, kWarning, kError };
+
+// Callers copy the message into a preallocated lock-free ring; a writer
+// thread keeps the log file open and writes out whole batches, so logging
+// costs no I/O, locks or allocation on the caller's thread
+class Logger {
+ public:
+  static Logger& GetInstance() {
+    static Logger instance;
+    return instance;
+  }
+
+  // Messages below level are discarded before they are formatted
+  void SetLevel(LogLevel level) {
+    min_level_.store(level, std::memory_order_relaxed);
+  }
+
+  bool IsEnabled(LogLevel level) const {
+    return level >= min_level_.load(std::memory_order_relaxed);
+  }
+
+  void Log(LogLevel level, const std::string& message) {
+    Log(level, message.data(), message.size());
+  }
+
+  void Log(LogLevel level, const char* message) {
+    Log(level, message, strlen(message));
+  }
+
+  // Longer messages are truncated; drops the message if the ring is full
+  void Log(LogLevel level, const char* message, size_t length) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    Record* record;
+    for (;;) {
+      record = &records_[position & (CursorConfig::kLogQueueSize - 1)];
+      const size_t sequence = record->sequence.load(std::memory_order_acquire);
+      const intptr_t difference =
+          static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+      if (difference == 0) {
+        if (enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        dropped_records_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+
+    GetSystemTimeAsFileTime(&record->time);
+    record->level = level;
+    record->length = static_cast<uint16_t>(
+        (std::min)(length, CursorConfig::kLogMessageSize));
+    memcpy(record->text, message, record->length);
+    record->sequence.store(position + 1, std::memory_order_release);
+
+    // Wake an idle writer to start a batch; within a batch only errors and
+    // a filling ring are worth a SetEvent
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (writer_idle_.exchange(false, std::memory_order_relaxed) ||
+        level == LogLevel::kError ||
+        position % CursorConfig::kLogFlushRecords ==
+            CursorConfig::kLogFlushRecords - 1) {
+      SetEvent(writer_event_);
+    }
+  }
+
+ private:
+  static_assert((CursorConfig::kLogQueueSize &
+                 (CursorConfig::kLogQueueSize - 1)) == 0,
+                "kLogQueueSize must be a power of two");
+
+  struct Record {
+    std::atomic<size_t> sequence;  // Position the slot is ready for
+    FILETIME time;
+    LogLevel level;
+    uint16_t length;
+    char text[CursorConfig::kLogMessageSize];
+  };
+
+  Logger() {
+#ifdef _DEBUG
+    min_level_ = LogLevel::kDebug;
+#endif
+    for (size_t i = 0; i < CursorConfig::kLogQueueSize; ++i) {
+      records_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer_event_ = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    writer_running_ = true;
+    writer_thread_ = std::thread(&Logger::WriterThreadProc, this);
+  }
+
+  ~Logger() {
+    writer_running_ = false;
+    SetEvent(writer_event_);
+    if (writer_thread_.joinable()) {
+      writer_thread_.join();
+    }
+    CloseHandle(writer_event_);
+  }
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
+  // Sleeps without a timeout while nothing is pending, so an idle process
+  // is not woken up by its logger
+  void WriterThreadProc() {
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+    bool running = true;
+    while (running) {
+      writer_idle_.store(true, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (!HasPendingRecord() && writer_running_) {
+        WaitForSingleObject(writer_event_, INFINITE);
+      }
+      writer_idle_.store(false, std::memory_order_relaxed);
+
+      // Let the batch fill up unless it is cut short
+      if (writer_running_) {
+        WaitForSingleObject(writer_event_, CursorConfig::kLogFlushIntervalMs);
+      }
+      running = writer_running_;
+      // One flush per batch instead of one per line
+      if (WriteRecords()) {
+        log_file_.flush();
+      }
+    }
+  }
+
+  bool HasPendingRecord() const {
+    const Record& record =
+        records_[dequeue_position_ & (CursorConfig::kLogQueueSize - 1)];
+    return record.sequence.load(std::memory_order_acquire) ==
+           dequeue_position_ + 1;
+  }
+
+  // Returns true if anything was written
+  bool WriteRecords() {
+    bool written = false;
+    while (HasPendingRecord()) {
+      Record& record =
+          records_[dequeue_position_ & (CursorConfig::kLogQueueSize - 1)];
+      if (!log_file_.is_open()) {
+        log_file_.open("ShakeToFindCursor.log", std::ios_base::app);
+      }
+      WriteTimestamp(record.time);
+      log_file_ << " [" << LevelName(record.level) << "] ";
+      log_file_.write(record.text, record.length);
+      log_file_ << '\n';
+      record.sequence.store(dequeue_position_ + CursorConfig::kLogQueueSize,
+                            std::memory_order_release);
+      dequeue_position_++;
+      written = true;
+    }
+
+    size_t dropped = dropped_records_.exchange(0, std::memory_order_relaxed);
+    if (dropped && log_file_.is_open()) {
+      log_file_ << "(" << dropped << " log messages dropped)\n";
+    }
+    return written;
+  }
+
+  void WriteTimestamp(const FILETIME& time) {
+    FILETIME local_time;
+    SYSTEMTIME st = {};
+    if (FileTimeToLocalFileTime(&time, &local_time)) {
+      FileTimeToSystemTime(&local_time, &st);
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04u-%02u-%02u %02u:%02u:%02u.%03u",
+             st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+             st.wMilliseconds);
+    log_file_ << buffer;
+  }
+
+  static const char* LevelName(LogLevel level) {
+    switch (level) {
+      case LogLevel::kDebug:
+        return "DEBUG";
+      case LogLevel::kInfo:
+        return "INFO";
+      case LogLevel::kWarning:
+        return "WARNING";
+      case LogLevel::kError:
+        return "ERROR";
+    }
+    return "";
+  }
+
+  Record records_[CursorConfig::kLogQueueSize];
+  std::atomic<size_t> enqueue_position_{0};
+  size_t dequeue_position_ = 0;  // Writer thread only
+  std::atomic<size_t> dropped_records_{0};
+  std::atomic<LogLevel> min_level_{LogLevel::kWarning};
+  std::ofstream log_file_;  // Writer thread only
+  HANDLE writer_event_ = nullptr;
+  std::thread writer_thread_;
+  std::atomic<bool> writer_running_{false};
+  std::atomic<bool> writer_idle_{false};
+};
+
+// The message expression is only evaluated when its level is enabled
+#define LOG_MESSAGE(level, msg)                        \
+  do {                                                 \
+    if (Logger::GetInstance().IsEnabled(level)) {      \
+      Logger::GetInstance().Log(level, msg);           \
+    }                                                  \
+  } while (0)
+#define DEBUG_LOG(msg) LOG_MESSAGE(LogLevel::kDebug, msg)
+#define ERROR_LOG(msg) LOG_MESSAGE(LogLevel::kError, msg)
+
+// High resolution timestamps based on QueryPerformanceCounter
+class HighResClock {
+ public:
+  static long long NowMicroseconds() {
+    return TicksToMicroseconds(NowTicks());
+  }
+
+  static long long NowTicks() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+  }
+
+  static long long TicksToMicroseconds(long long ticks) {
+    return TicksToUnits(ticks, 1000000);
+  }
+
+  static long long TicksToNanoseconds(long long ticks) {
+    return TicksToUnits(ticks, 1000000000);
+  }
+
+ private:
+  static long long TicksToUnits(long long ticks, long long units_per_second) {
+    static const long long frequency = [] {
+      LARGE_INTEGER freq;
+      QueryPerformanceFrequency(&freq);
+      return freq.QuadPart;
+    }();
+    // Split the conversion so large tick counts cannot overflow
+    return (ticks / frequency) * units_per_second +
+           (ticks % frequency) * units_per_second / frequency;
+  }
+};
+
+// Fixed-bucket histogram that any thread can record into without locking
+class LatencyHistogram {
+ public:
+  void Record(long long value) {
+    if (value < 0) value = 0;
+    buckets_[BucketIndex(static_cast<unsigned long long>(value))].fetch_add(
+        1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    long long max = max_.load(std::memory_order_relaxed);
+    while (value > max && !max_.compare_exchange_weak(
+                              max, value, std::memory_order_relaxed)) {
+    }
+  }
+
+  unsigned long long Count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+
+  long long Max() const { return max_.load(std::memory_order_relaxed); }
+
+  // Upper bound of the bucket holding the given fraction of the samples
+  long long Percentile(double fraction) const {
+    const unsigned long long count = Count();
+    if (count == 0) return 0;
+    const unsigned long long rank = (std::max)(
+        1ULL, static_cast<unsigned long long>(std::ceil(fraction * count)));
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < kBucketCount; ++i) {
+      seen += buckets_[i].load(std::memory_order_relaxed);
+      if (seen >= rank) {
+        // Never report more than was actually observed
+        return (std::min)(BucketUpperBound(i), Max());
+      }
+    }
+    return Max();
+  }
+
+ private:
+  // Values below 2 * kSubBuckets get a bucket each; above that every power
+  // of two is split into kSubBuckets, which bounds the error to 25%
+  static constexpr size_t kSubBuckets = 4;
+  static constexpr size_t kBucketCount = 128;
+
+  static size_t BucketIndex(unsigned long long value) {
+    size_t exponent = 0;
+    while (value >= 2 * kSubBuckets) {
+      value >>= 1;
+      ++exponent;
+    }
+    return (std::min)(exponent * kSubBuckets + static_cast<size_t>(value),
+                      kBucketCount - 1);
+  }
+
+  static long long BucketUpperBound(size_t index) {
+    if (index < 2 * kSubBuckets) return static_cast<long long>(index);
+    const size_t exponent = index / kSubBuckets - 1;
+    const long long mantissa =
+        static_cast<long long>(index - exponent * kSubBuckets);
+    return ((mantissa + 1) << exponent) - 1;
+  }
+
+  std::array<std::atomic<unsigned long long>, kBucketCount> buckets_{};
+  std::atomic<unsigned long long> count_{0};
+  std::atomic<long long> max_{0};
+};
+
+// Hot-path latencies and counters, shown from the tray menu and published
+// through the TraceLogging provider
+class LatencyStats {
+ public:
+  enum class Histogram {
+    kHookCallback,    // MouseProc
+    kDetection,       // Shake detection per sample or batch
+    kInputToEnlarge,  // Triggering sample to the first enlarged frame
+    kFrame,           // One animation step (cursor swap or overlay draw)
+    kHoldOvershoot,   // End of the hold to the start of shrinking
+    kCount
+  };
+
+  enum class Counter {
+    kSamplesProcessed,
+    kHookSamples,      // kSamplesProcessed by source
+    kPollingSamples,
+    kRawInputSamples,
+    kSamplesDropped,
+    kTriggers,      // Shakes detected
+    kEnlargements,  // Animations started from the original size
+    kTimerWakeups,  // Polling mode timer ticks
+    kCount
+  };
+
+  static LatencyStats& GetInstance() {
+    static LatencyStats instance;
+    return instance;
+  }
+
+  // All histograms are in nanoseconds
+  void Record(Histogram histogram, long long nanoseconds) {
+    histograms_[static_cast<size_t>(histogram)].Record(nanoseconds);
+  }
+
+  void Add(Counter counter, unsigned long long value = 1) {
+    counters_[static_cast<size_t>(counter)].fetch_add(
+        value, std::memory_order_relaxed);
+  }
+
+  unsigned long long Get(Counter counter) const {
+    return counters_[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  const LatencyHistogram& Get(Histogram histogram) const {
+    return histograms_[static_cast<size_t>(histogram)];
+  }
+
+  // Emits the time from a triggering sample to the enlarged cursor
+  void RecordEnlarge(long long trigger_time_us, UINT dpi, bool overlay) {
+    const long long latency_ns =
+        (HighResClock::NowMicroseconds() - trigger_time_us) * 1000;
+    Record(Histogram::kInputToEnlarge, latency_ns);
+    Add(Counter::kEnlargements);
+    TraceLoggingWrite(g_trace_provider, "Enlarge",
+                      TraceLoggingInt64(latency_ns, "InputToEnlargeNs"),
+                      TraceLoggingUInt32(dpi, "Dpi"),
+                      TraceLoggingBool(overlay, "Overlay"));
+  }
+
+  // Publishes a snapshot of the counters and the end-to-end latency
+  void TraceSnapshot() const {
+    const LatencyHistogram& latency = Get(Histogram::kInputToEnlarge);
+    TraceLoggingWrite(
+        g_trace_provider, "Stats",
+        TraceLoggingUInt64(Get(Counter::kSamplesProcessed),
+                           "SamplesProcessed"),
+        TraceLoggingUInt64(Get(Counter::kSamplesDropped), "SamplesDropped"),
+        TraceLoggingUInt64(Get(Counter::kTriggers), "Triggers"),
+        TraceLoggingUInt64(Get(Counter::kEnlargements), "Enlargements"),
+        TraceLoggingInt64(latency.Percentile(0.5), "InputToEnlargeP50Ns"),
+        TraceLoggingInt64(latency.Percentile(0.99), "InputToEnlargeP99Ns"),
+        TraceLoggingInt64(latency.Max(), "InputToEnlargeMaxNs"));
+  }
+
+  std::wstring Report() const {
+    static const LPCWSTR kHistogramNames[] = {
+        L"Hook callback", L"Detection", L"Input to enlarge", L"Frame",
+        L"Hold overshoot"};
+    static_assert(std::size(kHistogramNames) ==
+                      static_cast<size_t>(Histogram::kCount),
+                  "Missing histogram name");
+
+    std::wstringstream report;
+    report << std::fixed << std::setprecision(1);
+    report << L"Samples processed: " << Get(Counter::kSamplesProcessed)
+           << L"\nSamples dropped: " << Get(Counter::kSamplesDropped)
+           << L"\nTriggers: " << Get(Counter::kTriggers)
+           << L"\nEnlargements: " << Get(Counter::kEnlargements) << L"\n\n"
+           << L"Latency in \u00b5s (p50 / p99 / max, count)\n";
+    for (size_t i = 0; i < histograms_.size(); ++i) {
+      const LatencyHistogram& histogram = histograms_[i];
+      report << kHistogramNames[i] << L": "
+             << histogram.Percentile(0.5) / 1000.0 << L" / "
+             << histogram.Percentile(0.99) / 1000.0 << L" / "
+             << histogram.Max() / 1000.0 << L", " << histogram.Count()
+             << L"\n";
+    }
+    return report.str();
+  }
+
+ private:
+  LatencyStats() { TraceLoggingRegister(g_trace_provider); }
+  ~LatencyStats() {
+    TraceSnapshot();
+    TraceLoggingUnregister(g_trace_provider);
+  }
+  LatencyStats(const LatencyStats&) = delete;
+  LatencyStats& operator=(const LatencyStats&) = delete;
+
+  std::array<LatencyHistogram, static_cast<size_t>(Histogram::kCount)>
+      histograms_;
+  std::array<std::atomic<unsigned long long>,
+             static_cast<size_t>(Counter::kCount)>
+      counters_{};
+};
+
+// Measures the enclosing scope into one of the LatencyStats histograms
+class ScopedLatency {
+ public:
+  explicit ScopedLatency(LatencyStats::Histogram histogram)
+      : histogram_(histogram), start_(HighResClock::NowTicks()) {}
+
+  ~ScopedLatency() {
+    LatencyStats::GetInstance().Record(
+        histogram_,
+        HighResClock::TicksToNanoseconds(HighResClock::NowTicks() - start_));
+  }
+
+  ScopedLatency(const ScopedLatency&) = delete;
+  ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+ private:
+  LatencyStats::Histogram histogram_;
+  long long start_;
+};
+
+#endif  // SHAKE_COMMON_H_
@@ -0,0 +1,14 @@
+// clang-format off
+#include "shake_common.h"
+#include "cursor_scaler.h"
+#include "cursor_state.h"
+#include "mouse_detector.h"
+#include "shared_stats.h"
+// clang-format on
+
+// The GUID is the standard hash of the provider name, so tracing tools can
+// also enable it as *ShakeToFindCursor
+// {948795b1-b1f7-5ae9-320a-17f404c2ad7a}
+TRACELOGGING_DEFINE_PROVIDER(g_trace_provider, "ShakeToFindCursor",
+                             (0x948795b1, 0xb1f7, 0x5ae9, 0x32, 0x0a, 0x17,
+                              0xf4, 0x04, 0xc2, 0xad, 0x7a));
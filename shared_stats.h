@@ -0,0 +1,206 @@
+#ifndef SHARED_STATS_H_
+#define SHARED_STATS_H_
+
+#include "shake_common.h"
+#include "mouse_detector.h"
+
+// The named section kSharedStatsName holds one SharedStatsBlock, so that a
+// monitoring agent in the same session can read the counters and change the
+// thresholds without talking to the process. Layouts are fixed in native
+// byte order; anything incompatible bumps kVersion.
+
+// One LatencyStats histogram, in nanoseconds
+struct SharedStatsLatency {
+  int64_t p50_ns;
+  int64_t p99_ns;
+  int64_t max_ns;
+  uint64_t count;
+};
+
+struct SharedStatsData {
+  uint64_t samples[3];  // By CursorConfig::MouseTrackingMode
+  uint64_t samples_dropped;
+  uint64_t triggers;
+  uint64_t enlargements;
+  uint64_t timer_wakeups;  // Polling mode timer ticks
+  uint64_t publish_time;   // FILETIME of the last update, for staleness
+  SharedStatsLatency latencies[5];  // By LatencyStats::Histogram
+  uint32_t suspend_reasons;         // Non-zero while input is switched off
+  uint32_t applied_control;  // SharedStatsControl::sequence last applied
+  // Thresholds of the detector in use
+  uint32_t history_size;
+  int32_t min_direction_changes;
+  int32_t max_time_window;
+  uint32_t rejected_control;  // Last sequence with invalid thresholds
+  double min_movement_speed;
+};
+static_assert(sizeof(SharedStatsData) == 256, "Shared stats layout changed");
+static_assert(std::size(SharedStatsData().latencies) ==
+                  static_cast<size_t>(LatencyStats::Histogram::kCount),
+              "Shared stats histograms out of sync");
+
+// Written by the agent: make sequence odd, store the thresholds, make it
+// even again, then set the kSharedControlEventName event. Each new even
+// value is applied once, when the event is set, unless the speed or window
+// is not positive or fewer than one direction change is asked for.
+struct SharedStatsControl {
+  std::atomic<uint32_t> sequence;
+  uint32_t history_size;
+  int32_t min_direction_changes;
+  int32_t max_time_window;
+  double min_movement_speed;
+};
+static_assert(sizeof(SharedStatsControl) == 24, "Shared control changed");
+
+// sequence is a seqlock over data: it is odd while an update is in
+// progress, and a reader keeps a copy only if it read the same even value
+// before and after copying
+struct SharedStatsBlock {
+  static constexpr uint32_t kMagic = 0x53465453;  // "STFS"
+  static constexpr uint16_t kVersion = 1;
+
+  uint32_t magic;
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t size;  // sizeof(SharedStatsBlock) of the writer
+  std::atomic<uint32_t> sequence;
+  SharedStatsData data;
+  SharedStatsControl control;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "Shared stats need address-free atomics");
+static_assert(sizeof(SharedStatsBlock) == 296, "Shared stats layout changed");
+
+// Owns the section and is its only writer. Used on the UI thread.
+class SharedStatsPublisher {
+ public:
+  SharedStatsPublisher() {
+    mapping_ = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr,
+                                  PAGE_READWRITE, 0, sizeof(SharedStatsBlock),
+                                  CursorConfig::kSharedStatsName);
+    if (!mapping_) {
+      throw std::runtime_error("Failed to create shared stats section");
+    }
+    // An agent that keeps the section open outlives a restart of the app
+    const bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+    void* view = MapViewOfFile(mapping_, FILE_MAP_WRITE, 0, 0, 0);
+    if (!view) {
+      CloseHandle(mapping_);
+      throw std::runtime_error("Failed to map shared stats section");
+    }
+    if (existed) {
+      // Both sequences carry on, so readers never see one go backwards,
+      // and a command the previous instance took is not taken again
+      block_ = static_cast<SharedStatsBlock*>(view);
+      applied_control_ =
+          block_->control.sequence.load(std::memory_order_acquire) & ~1u;
+    } else {
+      // The new section is zeroed
+      block_ = new (view) SharedStatsBlock();
+    }
+    block_->magic = SharedStatsBlock::kMagic;
+    block_->version = SharedStatsBlock::kVersion;
+    block_->size = sizeof(SharedStatsBlock);
+
+    // Opened instead if the agent created it first
+    control_event_ = CreateEventW(nullptr, FALSE, FALSE,
+                                  CursorConfig::kSharedControlEventName);
+    if (!control_event_) {
+      UnmapViewOfFile(block_);
+      CloseHandle(mapping_);
+      throw std::runtime_error("Failed to create shared control event");
+    }
+  }
+
+  ~SharedStatsPublisher() {
+    CloseHandle(control_event_);
+    UnmapViewOfFile(block_);
+    CloseHandle(mapping_);
+  }
+
+  SharedStatsPublisher(const SharedStatsPublisher&) = delete;
+  SharedStatsPublisher& operator=(const SharedStatsPublisher&) = delete;
+
+  void Publish(unsigned suspend_reasons,
+               const RuntimeShakeConfig& thresholds) {
+    const LatencyStats& stats = LatencyStats::GetInstance();
+    using Counter = LatencyStats::Counter;
+    SharedStatsData data = {};
+    data.samples[0] = stats.Get(Counter::kHookSamples);
+    data.samples[1] = stats.Get(Counter::kPollingSamples);
+    data.samples[2] = stats.Get(Counter::kRawInputSamples);
+    data.samples_dropped = stats.Get(Counter::kSamplesDropped);
+    data.triggers = stats.Get(Counter::kTriggers);
+    data.enlargements = stats.Get(Counter::kEnlargements);
+    data.timer_wakeups = stats.Get(Counter::kTimerWakeups);
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    data.publish_time =
+        (static_cast<uint64_t>(now.dwHighDateTime) << 32) | now.dwLowDateTime;
+    for (size_t i = 0; i < std::size(data.latencies); ++i) {
+      const LatencyHistogram& histogram =
+          stats.Get(static_cast<LatencyStats::Histogram>(i));
+      data.latencies[i] = {histogram.Percentile(0.5),
+                           histogram.Percentile(0.99), histogram.Max(),
+                           histogram.Count()};
+    }
+    data.suspend_reasons = suspend_reasons;
+    data.applied_control = applied_control_;
+    data.rejected_control = rejected_control_;
+    data.history_size = static_cast<uint32_t>(thresholds.HistorySize());
+    data.min_direction_changes = thresholds.MinDirectionChanges();
+    data.max_time_window = thresholds.MaxTimeWindow();
+    data.min_movement_speed = thresholds.MinMovementSpeed();
+
+    // Percentiles are computed above so the odd window is a single copy.
+    // The sequence is already odd if a previous instance died mid-update.
+    const uint32_t sequence =
+        block_->sequence.load(std::memory_order_relaxed) | 1u;
+    block_->sequence.store(sequence, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(&block_->data, &data, sizeof(data));
+    block_->sequence.store(sequence + 1, std::memory_order_release);
+  }
+
+  // Signaled by the agent after it changes the control block
+  HANDLE ControlEvent() const { return control_event_; }
+
+  // Returns true and the requested thresholds once per completed change by
+  // the agent
+  bool TakeControl(RuntimeShakeConfig* thresholds) {
+    SharedStatsControl& control = block_->control;
+    const uint32_t sequence = control.sequence.load(std::memory_order_acquire);
+    if (sequence == applied_control_ || sequence == rejected_control_ ||
+        (sequence & 1)) {
+      return false;
+    }
+    const auto history_size = control.history_size;
+    const auto min_direction_changes = control.min_direction_changes;
+    const auto max_time_window = control.max_time_window;
+    const auto min_movement_speed = control.min_movement_speed;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Torn by a concurrent change; the next pass sees it complete
+    if (control.sequence.load(std::memory_order_relaxed) != sequence) {
+      return false;
+    }
+    const RuntimeShakeConfig requested(history_size, min_direction_changes,
+                                       min_movement_speed, max_time_window);
+    if (!requested.IsValid()) {
+      rejected_control_ = sequence;
+      LOG_MESSAGE(LogLevel::kWarning, "Rejected invalid shared thresholds");
+      return false;
+    }
+    applied_control_ = sequence;
+    *thresholds = requested;
+    return true;
+  }
+
+ private:
+  HANDLE mapping_ = nullptr;
+  HANDLE control_event_ = nullptr;
+  SharedStatsBlock* block_ = nullptr;
+  uint32_t applied_control_ = 0;
+  uint32_t rejected_control_ = 0;
+};
+
+#endif  // SHARED_STATS_H_